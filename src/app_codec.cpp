@@ -0,0 +1,537 @@
+#include "app_codec.hpp"
+
+#include <array>
+#include <cmath>
+#include <cstdint>
+#include <cstdlib>
+#include <charconv>
+#include <cstring>
+#include <iterator>
+#include <algorithm>
+#include <stdexcept>
+
+#include <nlohmann/json.hpp>
+
+#include "app_msg.hpp"
+
+namespace occase
+{
+
+namespace
+{
+
+// The field names of the app protocol. Never reorder or remove them,
+// apps rely on the positions.
+constexpr std::array<std::string_view, 36> field_names
+{ "cmd"
+, "result"
+, "from"
+, "to"
+, "type"
+, "id"
+, "post_id"
+, "message"
+, "nick"
+, "refers_to"
+, "is_redirected"
+, "ack_id"
+, "user"
+, "key"
+, "token"
+, "admin_id"
+, "reason"
+, "date"
+, "post"
+, "posts"
+, "cursor"
+, "avatar"
+, "description"
+, "location"
+, "product"
+, "ex_details"
+, "in_details"
+, "range_values"
+, "images"
+, "visualizations"
+, "credit"
+, "user_id"
+, "order_by"
+, "count"
+, "name"
+, "value"
+};
+
+// Above this nesting depth messages are rejected.
+auto constexpr max_depth = 32;
+
+int field_index(std::string_view name) noexcept
+{
+   auto const match =
+      std::find(std::cbegin(field_names), std::cend(field_names), name);
+
+   if (match == std::cend(field_names))
+      return -1;
+
+   return std::distance(std::cbegin(field_names), match);
+}
+
+struct writer {
+   std::string buffer;
+
+   template <class T>
+   void big_endian(std::uint8_t tag, T v)
+   {
+      buffer.push_back(char(tag));
+      for (int i = sizeof v - 1; i >= 0; --i)
+         buffer.push_back(char(std::uint64_t(v) >> (8 * i)));
+   }
+
+   void unsigned_integer(std::uint64_t v)
+   {
+      if (v < 0x80)
+         buffer.push_back(char(v));
+      else if (v <= 0xff)
+         big_endian(0xcc, std::uint8_t(v));
+      else if (v <= 0xffff)
+         big_endian(0xcd, std::uint16_t(v));
+      else if (v <= 0xffffffff)
+         big_endian(0xce, std::uint32_t(v));
+      else
+         big_endian(0xcf, v);
+   }
+
+   void integer(std::int64_t v)
+   {
+      if (v >= 0)
+         unsigned_integer(v);
+      else if (v >= -32)
+         buffer.push_back(char(v));
+      else if (v >= INT8_MIN)
+         big_endian(0xd0, std::int8_t(v));
+      else if (v >= INT16_MIN)
+         big_endian(0xd1, std::int16_t(v));
+      else if (v >= INT32_MIN)
+         big_endian(0xd2, std::int32_t(v));
+      else
+         big_endian(0xd3, v);
+   }
+
+   void string(std::string_view s)
+   {
+      auto const n = std::size(s);
+      if (n < 32)
+         buffer.push_back(char(0xa0 | n));
+      else if (n <= 0xff)
+         big_endian(0xd9, std::uint8_t(n));
+      else if (n <= 0xffff)
+         big_endian(0xda, std::uint16_t(n));
+      else
+         big_endian(0xdb, std::uint32_t(n));
+
+      buffer.append(s);
+   }
+
+   void header(std::size_t n, std::uint8_t fix, std::uint8_t tag16)
+   {
+      if (n < 16)
+         buffer.push_back(char(fix | n));
+      else if (n <= 0xffff)
+         big_endian(tag16, std::uint16_t(n));
+      else
+         big_endian(tag16 + 1, std::uint32_t(n));
+   }
+};
+
+// Encodes json text, that is known to be valid, without building a
+// json document. The number of elements of objects and arrays is only
+// known at their end, where their header is inserted before the
+// elements.
+struct transcoder : writer {
+   char const* p;
+   char const* end;
+
+   // Strings with escape sequences are decoded here.
+   std::string decoded;
+
+   transcoder(std::string_view text)
+   : p {text.data()}
+   , end {text.data() + std::size(text)}
+   {
+      buffer.reserve(std::size(text));
+   }
+
+   void skip_space() noexcept
+   {
+      while (p != end && (*p == ' ' || *p == '\t' || *p == '\n' || *p == '\r'))
+         ++p;
+   }
+
+   // Reads the string that starts at p. The view is valid until the
+   // next call.
+   std::string_view string_value()
+   {
+      auto const begin = ++p;
+      auto escaped = false;
+      for (; *p != '"'; ++p) {
+         if (*p == '\\') {
+            escaped = true;
+            ++p;
+         }
+      }
+
+      std::string_view const ret {begin, std::size_t(p - begin)};
+      ++p;
+
+      if (!escaped)
+         return ret;
+
+      unescape_json_string(ret, decoded);
+      return decoded;
+   }
+
+   void number()
+   {
+      auto is_number = [](char c)
+         { return (c >= '0' && c <= '9') || c == '-' || c == '+' || c == '.' || c == 'e' || c == 'E'; };
+
+      auto const begin = p;
+      auto is_integer = true;
+      for (; p != end && is_number(*p); ++p) {
+         if (*p == '.' || *p == 'e' || *p == 'E')
+            is_integer = false;
+      }
+
+      // Like json::parse, integers that don't fit in 64 bits are
+      // stored as floating point.
+      if (is_integer) {
+         if (*begin == '-') {
+            std::int64_t v;
+            if (std::from_chars(begin, p, v).ec == std::errc {}) {
+               integer(v);
+               return;
+            }
+         } else {
+            std::uint64_t v;
+            if (std::from_chars(begin, p, v).ec == std::errc {}) {
+               unsigned_integer(v);
+               return;
+            }
+         }
+      }
+
+      std::uint64_t bits;
+      auto const d = std::strtod(std::string {begin, p}.data(), nullptr);
+      std::memcpy(&bits, &d, sizeof bits);
+      big_endian(0xcb, bits);
+   }
+
+   void insert_header(std::size_t pos, std::size_t n, std::uint8_t fix, std::uint8_t tag16)
+   {
+      writer h;
+      h.header(n, fix, tag16);
+      buffer.insert(pos, h.buffer);
+   }
+
+   void object()
+   {
+      auto const pos = std::size(buffer);
+      std::size_t n = 0;
+
+      ++p;
+      skip_space();
+      while (*p != '}') {
+         auto const key = string_value();
+         auto const i = field_index(key);
+         if (i < 0)
+            string(key);
+         else
+            buffer.push_back(char(i));
+
+         skip_space();
+         ++p;
+         value();
+         ++n;
+
+         skip_space();
+         if (*p == ',') {
+            ++p;
+            skip_space();
+         }
+      }
+
+      ++p;
+      insert_header(pos, n, 0x80, 0xde);
+   }
+
+   void array()
+   {
+      auto const pos = std::size(buffer);
+      std::size_t n = 0;
+
+      ++p;
+      skip_space();
+      while (*p != ']') {
+         value();
+         ++n;
+
+         skip_space();
+         if (*p == ',')
+            ++p;
+      }
+
+      ++p;
+      insert_header(pos, n, 0x90, 0xdc);
+   }
+
+   void value()
+   {
+      skip_space();
+      switch (*p) {
+         case '"': string(string_value()); break;
+         case '{': object(); break;
+         case '[': array(); break;
+         case 't':
+         {
+            buffer.push_back(char(0xc3));
+            p += 4;
+         } break;
+         case 'f':
+         {
+            buffer.push_back(char(0xc2));
+            p += 5;
+         } break;
+         case 'n':
+         {
+            buffer.push_back(char(0xc0));
+            p += 4;
+         } break;
+         default:
+            number();
+      }
+   }
+};
+
+struct reader {
+   char const* p;
+   char const* end;
+   std::string out;
+
+   void check(std::size_t n) const
+   {
+      if (std::size_t(end - p) < n)
+         throw std::runtime_error("from_binary: truncated message.");
+   }
+
+   template <class T>
+   T big_endian()
+   {
+      check(sizeof (T));
+      std::uint64_t ret = 0;
+      for (auto i = 0U; i < sizeof (T); ++i)
+         ret = (ret << 8) | std::uint8_t(*p++);
+
+      return T(ret);
+   }
+
+   std::string_view string(std::size_t n)
+   {
+      check(n);
+      std::string_view const ret {p, n};
+      p += n;
+      return ret;
+   }
+
+   // Reads the size of a string, returns false if the tag is not a
+   // string.
+   bool string_size(std::uint8_t tag, std::size_t& n)
+   {
+      if ((tag & 0xe0) == 0xa0)
+         n = tag & 0x1f;
+      else if (tag == 0xd9)
+         n = big_endian<std::uint8_t>();
+      else if (tag == 0xda)
+         n = big_endian<std::uint16_t>();
+      else if (tag == 0xdb)
+         n = big_endian<std::uint32_t>();
+      else
+         return false;
+
+      return true;
+   }
+
+   std::uint8_t tag()
+   {
+      check(1);
+      return std::uint8_t(*p++);
+   }
+
+   void key()
+   {
+      auto const t = tag();
+      if (t < std::size(field_names)) {
+         append_json_string(out, field_names[t]);
+         return;
+      }
+
+      std::size_t n = 0;
+      if (!string_size(t, n))
+         throw std::runtime_error("from_binary: invalid key.");
+
+      append_json_string(out, string(n));
+   }
+
+   void array(std::size_t n, int depth)
+   {
+      out.push_back('[');
+      for (auto i = 0U; i < n; ++i) {
+         if (i != 0)
+            out.push_back(',');
+         value(depth + 1);
+      }
+
+      out.push_back(']');
+   }
+
+   void map(std::size_t n, int depth)
+   {
+      out.push_back('{');
+      for (auto i = 0U; i < n; ++i) {
+         if (i != 0)
+            out.push_back(',');
+         key();
+         out.push_back(':');
+         value(depth + 1);
+      }
+
+      out.push_back('}');
+   }
+
+   void floating(double d)
+   {
+      // With the algorithm of json::dump, that keeps a trailing .0 on
+      // integral values so that they are still read as floating point.
+      if (std::isfinite(d)) {
+         std::array<char, 64> buffer;
+         auto* const end =
+            nlohmann::detail::to_chars(buffer.data(), buffer.data() + std::size(buffer), d);
+         out.append(buffer.data(), end);
+      } else {
+         out += "null";
+      }
+   }
+
+   void value(int depth)
+   {
+      if (depth > max_depth)
+         throw std::runtime_error("from_binary: nesting too deep.");
+
+      auto const t = tag();
+
+      std::size_t n = 0;
+      if (string_size(t, n)) {
+         append_json_string(out, string(n));
+         return;
+      }
+
+      if (t < 0x80) {
+         out += std::to_string(t);
+         return;
+      }
+
+      if (t >= 0xe0) {
+         out += std::to_string(std::int8_t(t));
+         return;
+      }
+
+      if ((t & 0xf0) == 0x80) {
+         map(t & 0x0f, depth);
+         return;
+      }
+
+      if ((t & 0xf0) == 0x90) {
+         array(t & 0x0f, depth);
+         return;
+      }
+
+      switch (t) {
+         case 0xc0: out += "null"; break;
+         case 0xc2: out += "false"; break;
+         case 0xc3: out += "true"; break;
+         case 0xcc: out += std::to_string(big_endian<std::uint8_t>()); break;
+         case 0xcd: out += std::to_string(big_endian<std::uint16_t>()); break;
+         case 0xce: out += std::to_string(big_endian<std::uint32_t>()); break;
+         case 0xcf: out += std::to_string(big_endian<std::uint64_t>()); break;
+         case 0xd0: out += std::to_string(big_endian<std::int8_t>()); break;
+         case 0xd1: out += std::to_string(big_endian<std::int16_t>()); break;
+         case 0xd2: out += std::to_string(big_endian<std::int32_t>()); break;
+         case 0xd3: out += std::to_string(big_endian<std::int64_t>()); break;
+         case 0xca:
+         {
+            float f;
+            auto const bits = big_endian<std::uint32_t>();
+            std::memcpy(&f, &bits, sizeof f);
+            floating(f);
+         } break;
+         case 0xcb:
+         {
+            double d;
+            auto const bits = big_endian<std::uint64_t>();
+            std::memcpy(&d, &bits, sizeof d);
+            floating(d);
+         } break;
+         case 0xdc: array(big_endian<std::uint16_t>(), depth); break;
+         case 0xdd: array(big_endian<std::uint32_t>(), depth); break;
+         case 0xde: map(big_endian<std::uint16_t>(), depth); break;
+         case 0xdf: map(big_endian<std::uint32_t>(), depth); break;
+         default:
+            throw std::runtime_error("from_binary: unsupported type.");
+      }
+   }
+};
+
+} // anonymous
+
+bool offers_binary(std::string_view protocols) noexcept
+{
+   auto is_space = [](char c)
+      { return c == ' ' || c == '\t'; };
+
+   while (!std::empty(protocols)) {
+      auto const comma = protocols.find(',');
+      auto name = protocols.substr(0, comma);
+      protocols.remove_prefix(comma == std::string_view::npos ? std::size(protocols) : comma + 1);
+
+      while (!std::empty(name) && is_space(name.front()))
+         name.remove_prefix(1);
+
+      while (!std::empty(name) && is_space(name.back()))
+         name.remove_suffix(1);
+
+      if (name == binary_subprotocol)
+         return true;
+   }
+
+   return false;
+}
+
+std::string to_binary(std::string_view text)
+{
+   if (!is_json(text))
+      throw std::runtime_error("to_binary: invalid json.");
+
+   transcoder t {text};
+   t.value();
+   return std::move(t.buffer);
+}
+
+std::string from_binary(std::string_view bytes)
+{
+   reader r {bytes.data(), bytes.data() + std::size(bytes)};
+   r.value(0);
+   if (r.p != r.end)
+      throw std::runtime_error("from_binary: trailing bytes.");
+
+   return std::move(r.out);
+}
+
+} // occase
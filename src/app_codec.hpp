@@ -0,0 +1,30 @@
+#pragma once
+
+#include <string>
+#include <string_view>
+
+namespace occase {
+
+// The websocket subprotocol apps request in Sec-WebSocket-Protocol to
+// exchange binary frames instead of json text.
+constexpr std::string_view binary_subprotocol = "occase.msgpack.v1";
+
+// Converts app messages between json text, which the server stores
+// and forwards, and the encoding of the binary subprotocol.
+//
+// The binary encoding is MessagePack where the names of the fields
+// in field_names (see app_codec.cpp) are replaced by their position in
+// that table, so that they take one byte. Other names are stored as
+// strings. New names can only be appended to the table.
+
+// Returns true if the value of the Sec-WebSocket-Protocol header of
+// an upgrade request lists the binary subprotocol.
+bool offers_binary(std::string_view protocols) noexcept;
+
+// Throws if text is not valid json.
+std::string to_binary(std::string_view text);
+
+// Throws if bytes is not a valid encoding.
+std::string from_binary(std::string_view bytes);
+
+} // occase
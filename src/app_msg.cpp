@@ -0,0 +1,634 @@
+#include "app_msg.hpp"
+
+#include <cstdio>
+#include <cstdint>
+#include <charconv>
+#include <iterator>
+#include <algorithm>
+#include <stdexcept>
+
+namespace occase
+{
+
+namespace
+{
+
+bool is_space(char c) noexcept
+{
+   return c == ' ' || c == '\t' || c == '\n' || c == '\r';
+}
+
+char const* skip_space(char const* p, char const* end) noexcept
+{
+   while (p != end && is_space(*p))
+      ++p;
+
+   return p;
+}
+
+// Returns the size of the UTF-8 sequence at the start of s or zero if
+// it is not valid, with the same rules as json::dump.
+std::size_t utf8_size(std::string_view s) noexcept
+{
+   auto const b = [&](std::size_t i)
+      { return i < std::size(s) ? std::uint8_t(s[i]) : 0; };
+
+   auto const cont = [&](std::size_t i, std::uint8_t lo = 0x80, std::uint8_t hi = 0xbf)
+      { return b(i) >= lo && b(i) <= hi; };
+
+   auto const c = b(0);
+   if (c < 0x80)
+      return 1;
+
+   if (c >= 0xc2 && c <= 0xdf)
+      return cont(1) ? 2 : 0;
+
+   if (c == 0xe0)
+      return cont(1, 0xa0) && cont(2) ? 3 : 0;
+
+   if (c == 0xed)
+      return cont(1, 0x80, 0x9f) && cont(2) ? 3 : 0;
+
+   if (c >= 0xe1 && c <= 0xef)
+      return cont(1) && cont(2) ? 3 : 0;
+
+   if (c == 0xf0)
+      return cont(1, 0x90) && cont(2) && cont(3) ? 4 : 0;
+
+   if (c >= 0xf1 && c <= 0xf3)
+      return cont(1) && cont(2) && cont(3) ? 4 : 0;
+
+   if (c == 0xf4)
+      return cont(1, 0x80, 0x8f) && cont(2) && cont(3) ? 4 : 0;
+
+   return 0;
+}
+
+int hex_value(char c) noexcept
+{
+   if (c >= '0' && c <= '9')
+      return c - '0';
+
+   if (c >= 'a' && c <= 'f')
+      return c - 'a' + 10;
+
+   if (c >= 'A' && c <= 'F')
+      return c - 'A' + 10;
+
+   return -1;
+}
+
+// Returns the code unit of the four hex digits at p or -1.
+int hex4(char const* p, char const* end) noexcept
+{
+   if (end - p < 4)
+      return -1;
+
+   auto ret = 0;
+   for (auto i = 0; i < 4; ++i) {
+      auto const d = hex_value(p[i]);
+      if (d < 0)
+         return -1;
+
+      ret = 16 * ret + d;
+   }
+
+   return ret;
+}
+
+// The functions below return the position after the json value that
+// starts at p or nullptr if it is not valid. They accept the same
+// text as json::parse.
+
+// The maximum depth of nested objects and arrays.
+auto constexpr max_depth = 64;
+
+char const* skip_string(char const* p, char const* end) noexcept
+{
+   for (++p; p != end;) {
+      auto const c = std::uint8_t(*p);
+      if (c == '"')
+         return p + 1;
+
+      if (c < 0x20)
+         return nullptr;
+
+      if (c >= 0x80) {
+         auto const n = utf8_size({p, std::size_t(end - p)});
+         if (n == 0)
+            return nullptr;
+
+         p += n;
+         continue;
+      }
+
+      if (c != '\\') {
+         ++p;
+         continue;
+      }
+
+      if (++p == end)
+         return nullptr;
+
+      switch (*p++) {
+         case '"': case '\\': case '/': case 'b':
+         case 'f': case 'n': case 'r': case 't':
+            break;
+         case 'u':
+         {
+            auto const cp = hex4(p, end);
+            p += 4;
+            if (cp < 0 || (cp >= 0xdc00 && cp < 0xe000))
+               return nullptr;
+
+            // A high surrogate must be followed by a low one.
+            if (cp >= 0xd800 && cp < 0xdc00) {
+               if (end - p < 6 || p[0] != '\\' || p[1] != 'u')
+                  return nullptr;
+
+               auto const low = hex4(p + 2, end);
+               if (low < 0xdc00 || low >= 0xe000)
+                  return nullptr;
+
+               p += 6;
+            }
+         } break;
+         default:
+            return nullptr;
+      }
+   }
+
+   return nullptr;
+}
+
+char const* skip_number(char const* p, char const* end) noexcept
+{
+   auto digit = [&]
+      { return p != end && *p >= '0' && *p <= '9'; };
+
+   auto digits = [&]
+   {
+      if (!digit())
+         return false;
+
+      while (digit())
+         ++p;
+
+      return true;
+   };
+
+   if (p != end && *p == '-')
+      ++p;
+
+   if (p != end && *p == '0')
+      ++p;
+   else if (!digits())
+      return nullptr;
+
+   if (p != end && *p == '.') {
+      ++p;
+      if (!digits())
+         return nullptr;
+   }
+
+   if (p != end && (*p == 'e' || *p == 'E')) {
+      ++p;
+      if (p != end && (*p == '+' || *p == '-'))
+         ++p;
+
+      if (!digits())
+         return nullptr;
+   }
+
+   return p;
+}
+
+char const*
+skip_literal(char const* p, char const* end, std::string_view literal) noexcept
+{
+   if (std::string_view {p, std::size_t(end - p)}.starts_with(literal))
+      return p + std::size(literal);
+
+   return nullptr;
+}
+
+char const* skip_value(char const* p, char const* end, int depth) noexcept;
+
+// Objects and arrays.
+char const* skip_container(char const* p, char const* end, int depth) noexcept
+{
+   auto const close = *p == '{' ? '}' : ']';
+
+   p = skip_space(p + 1, end);
+   if (p != end && *p == close)
+      return p + 1;
+
+   for (;;) {
+      if (close == '}') {
+         if (p == end || *p != '"')
+            return nullptr;
+
+         p = skip_string(p, end);
+         if (!p)
+            return nullptr;
+
+         p = skip_space(p, end);
+         if (p == end || *p != ':')
+            return nullptr;
+
+         p = skip_space(p + 1, end);
+      }
+
+      p = skip_value(p, end, depth);
+      if (!p)
+         return nullptr;
+
+      p = skip_space(p, end);
+      if (p == end)
+         return nullptr;
+
+      if (*p == close)
+         return p + 1;
+
+      if (*p != ',')
+         return nullptr;
+
+      p = skip_space(p + 1, end);
+   }
+}
+
+char const* skip_value(char const* p, char const* end, int depth) noexcept
+{
+   if (p == end)
+      return nullptr;
+
+   switch (*p) {
+      case '"':
+         return skip_string(p, end);
+      case '{':
+      case '[':
+         return depth == max_depth ? nullptr : skip_container(p, end, depth + 1);
+      case 't':
+         return skip_literal(p, end, "true");
+      case 'f':
+         return skip_literal(p, end, "false");
+      case 'n':
+         return skip_literal(p, end, "null");
+      default:
+         return skip_number(p, end);
+   }
+}
+
+int hex_digit(char c)
+{
+   auto const ret = hex_value(c);
+   if (ret < 0)
+      throw std::runtime_error("app_msg: invalid escape sequence.");
+
+   return ret;
+}
+
+unsigned read_code_unit(std::string_view s, std::size_t& i)
+{
+   if (i + 4 > std::size(s))
+      throw std::runtime_error("app_msg: invalid escape sequence.");
+
+   unsigned ret = 0;
+   for (auto j = 0; j < 4; ++j)
+      ret = 16 * ret + hex_digit(s[i++]);
+
+   return ret;
+}
+
+void append_utf8(std::string& out, unsigned cp)
+{
+   if (cp < 0x80) {
+      out.push_back(char(cp));
+   } else if (cp < 0x800) {
+      out.push_back(char(0xc0 | (cp >> 6)));
+      out.push_back(char(0x80 | (cp & 0x3f)));
+   } else if (cp < 0x10000) {
+      out.push_back(char(0xe0 | (cp >> 12)));
+      out.push_back(char(0x80 | ((cp >> 6) & 0x3f)));
+      out.push_back(char(0x80 | (cp & 0x3f)));
+   } else {
+      out.push_back(char(0xf0 | (cp >> 18)));
+      out.push_back(char(0x80 | ((cp >> 12) & 0x3f)));
+      out.push_back(char(0x80 | ((cp >> 6) & 0x3f)));
+      out.push_back(char(0x80 | (cp & 0x3f)));
+   }
+}
+
+} // anonymous
+
+void unescape_json_string(std::string_view s, std::string& out)
+{
+   out.clear();
+   for (std::size_t i = 0; i < std::size(s);) {
+      if (s[i] != '\\') {
+         out.push_back(s[i++]);
+         continue;
+      }
+
+      if (++i == std::size(s))
+         throw std::runtime_error("app_msg: invalid escape sequence.");
+
+      switch (s[i++]) {
+         case '"': out.push_back('"'); break;
+         case '\\': out.push_back('\\'); break;
+         case '/': out.push_back('/'); break;
+         case 'b': out.push_back('\b'); break;
+         case 'f': out.push_back('\f'); break;
+         case 'n': out.push_back('\n'); break;
+         case 'r': out.push_back('\r'); break;
+         case 't': out.push_back('\t'); break;
+         case 'u':
+         {
+            auto cp = read_code_unit(s, i);
+            if (cp >= 0xd800 && cp < 0xdc00) {
+               // High surrogate, the low one must follow.
+               if (i + 2 > std::size(s) || s[i] != '\\' || s[i + 1] != 'u')
+                  throw std::runtime_error("app_msg: invalid escape sequence.");
+
+               i += 2;
+               auto const low = read_code_unit(s, i);
+               if (low < 0xdc00 || low >= 0xe000)
+                  throw std::runtime_error("app_msg: invalid escape sequence.");
+
+               cp = 0x10000 + ((cp - 0xd800) << 10) + (low - 0xdc00);
+            }
+
+            append_utf8(out, cp);
+         } break;
+         default:
+            throw std::runtime_error("app_msg: invalid escape sequence.");
+      }
+   }
+}
+
+bool is_json(std::string_view text) noexcept
+{
+   auto const end = text.data() + std::size(text);
+   auto const p = skip_value(skip_space(text.data(), end), end, 0);
+   return p && skip_space(p, end) == end;
+}
+
+void append_json_string(std::string& out, std::string_view s)
+{
+   auto const plain = [](char c)
+      { return std::uint8_t(c) >= 0x20 && std::uint8_t(c) < 0x80 && c != '"' && c != '\\'; };
+
+   out.push_back('"');
+   for (std::size_t i = 0; i < std::size(s); ++i) {
+      // Runs of characters that need no escaping are copied at once.
+      auto j = i;
+      while (j < std::size(s) && plain(s[j]))
+         ++j;
+
+      if (j != i) {
+         out.append(s.data() + i, j - i);
+         i = j - 1;
+         continue;
+      }
+
+      auto const c = s[i];
+      if (std::uint8_t(c) >= 0x80) {
+         auto const n = utf8_size(s.substr(i));
+         if (n == 0)
+            throw std::runtime_error("append_json_string: invalid UTF-8.");
+
+         out.append(s.substr(i, n));
+         i += n - 1;
+         continue;
+      }
+
+      switch (c) {
+         case '"': out += "\\\""; break;
+         case '\\': out += "\\\\"; break;
+         case '\b': out += "\\b"; break;
+         case '\f': out += "\\f"; break;
+         case '\n': out += "\\n"; break;
+         case '\r': out += "\\r"; break;
+         case '\t': out += "\\t"; break;
+         default:
+         {
+            if (std::uint8_t(c) < 0x20) {
+               char buffer[8];
+               std::snprintf(buffer, sizeof buffer, "\\u%04x", unsigned(c));
+               out += buffer;
+            } else {
+               out.push_back(c);
+            }
+         }
+      }
+   }
+
+   out.push_back('"');
+}
+
+app_cmd to_app_cmd(std::string_view cmd) noexcept
+{
+   // The size tells most commands apart, so that at most two string
+   // comparisons are made.
+   switch (std::size(cmd)) {
+      case 5:
+      {
+         if (cmd == "login")
+            return app_cmd::login;
+      } break;
+      case 7:
+      {
+         if (cmd == "message")
+            return app_cmd::message;
+         if (cmd == "publish")
+            return app_cmd::publish;
+      } break;
+      case 8:
+      {
+         if (cmd == "presence")
+            return app_cmd::presence;
+      } break;
+      default:
+         break;
+   }
+
+   return app_cmd::unknown;
+}
+
+bool app_msg::parse(std::string_view text)
+{
+   text_ = text;
+   size_ = 0;
+   cmd_ = app_cmd::unknown;
+
+   auto const end = text.data() + std::size(text);
+   auto p = skip_space(text.data(), end);
+   if (p == end || *p != '{')
+      return false;
+
+   p = skip_space(p + 1, end);
+   if (p != end && *p == '}') {
+      p = skip_space(p + 1, end);
+      return p == end;
+   }
+
+   for (;;) {
+      if (p == end || *p != '"')
+         return false;
+
+      auto const key_end = skip_string(p, end);
+      if (!key_end)
+         return false;
+
+      // Keys are compared as they are in the text, so keys with
+      // escape sequences could duplicate others unnoticed. The app
+      // does not send them.
+      std::string_view const key {p + 1, std::size_t(key_end - p - 2)};
+      if (key.find('\\') != std::string_view::npos || find(key) >= 0)
+         return false;
+
+      p = skip_space(key_end, end);
+      if (p == end || *p != ':')
+         return false;
+
+      p = skip_space(p + 1, end);
+      if (p == end)
+         return false;
+
+      auto const value_end = skip_value(p, end, 0);
+      if (!value_end || size_ == max_fields)
+         return false;
+
+      fields_[size_++] = {key, {p, std::size_t(value_end - p)}};
+
+      p = skip_space(value_end, end);
+      if (p == end)
+         return false;
+
+      if (*p == '}')
+         break;
+
+      if (*p != ',')
+         return false;
+
+      p = skip_space(p + 1, end);
+   }
+
+   if (skip_space(p + 1, end) != end)
+      return false;
+
+   auto const i = find("cmd");
+   if (i >= 0) {
+      auto const v = fields_[i].value;
+      if (v.front() == '"')
+         cmd_ = to_app_cmd(v.substr(1, std::size(v) - 2));
+   }
+
+   return true;
+}
+
+int app_msg::find(std::string_view key) const noexcept
+{
+   // Keys are unique, see parse.
+   for (auto i = 0; i < size_; ++i) {
+      if (fields_[i].key == key)
+         return i;
+   }
+
+   return -1;
+}
+
+int app_msg::at(std::string_view key) const
+{
+   auto const i = find(key);
+   if (i < 0)
+      throw std::runtime_error("app_msg: missing field " + std::string {key} + ".");
+
+   return i;
+}
+
+std::string_view app_msg::raw(std::string_view key) const
+{
+   return fields_[at(key)].value;
+}
+
+std::string_view app_msg::get_string(std::string_view key)
+{
+   auto const i = at(key);
+   auto const v = fields_[i].value;
+   if (v.front() != '"')
+      throw std::runtime_error("app_msg: field " + std::string {key} + " is not a string.");
+
+   auto const s = v.substr(1, std::size(v) - 2);
+   if (s.find('\\') == std::string_view::npos)
+      return s;
+
+   unescape_json_string(s, decoded_[i]);
+   return decoded_[i];
+}
+
+int app_msg::get_int(std::string_view key) const
+{
+   auto const v = fields_[at(key)].value;
+
+   int ret = 0;
+   auto const end = v.data() + std::size(v);
+   auto const [ptr, ec] = std::from_chars(v.data(), end, ret);
+   if (ec != std::errc {} || ptr != end)
+      throw std::runtime_error("app_msg: field " + std::string {key} + " is not an integer.");
+
+   return ret;
+}
+
+void
+app_msg::rewrite(
+   std::initializer_list<std::pair<std::string_view, std::string_view>> fields,
+   std::string& out) const
+{
+   // The values to replace ordered by their position in the text.
+   std::array<std::pair<std::string_view, std::string_view>, max_fields> replaced;
+   auto n = 0;
+   for (auto const& e : fields) {
+      auto const i = find(e.first);
+      if (i >= 0 && n < max_fields)
+         replaced[n++] = {fields_[i].value, e.second};
+   }
+
+   auto comp = [](auto const& a, auto const& b)
+      { return a.first.data() < b.first.data(); };
+
+   std::sort(std::begin(replaced), std::begin(replaced) + n, comp);
+
+   out.clear();
+   out.reserve(std::size(text_) + 128);
+
+   auto p = text_.data();
+   for (auto i = 0; i < n; ++i) {
+      auto const& e = replaced[i];
+      out.append(p, e.first.data());
+      append_json_string(out, e.second);
+      p = e.first.data() + std::size(e.first);
+   }
+
+   // The missing fields go before the closing brace.
+   auto const close = text_.data() + text_.rfind('}');
+   out.append(p, close);
+
+   auto has_fields = size_ != 0;
+   for (auto const& e : fields) {
+      if (find(e.first) >= 0)
+         continue;
+
+      if (has_fields)
+         out.push_back(',');
+
+      append_json_string(out, e.first);
+      out.push_back(':');
+      append_json_string(out, e.second);
+      has_fields = true;
+   }
+
+   out.append(close, text_.data() + std::size(text_));
+}
+
+} // occase
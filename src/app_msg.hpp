@@ -0,0 +1,101 @@
+#pragma once
+
+#include <array>
+#include <string>
+#include <utility>
+#include <string_view>
+#include <initializer_list>
+
+namespace occase {
+
+// The commands the app sends to the worker on the websocket.
+enum class app_cmd
+{ unknown
+, login
+, message
+, presence
+, publish
+};
+
+// Maps the cmd field of an app message to the command.
+app_cmd to_app_cmd(std::string_view cmd) noexcept;
+
+// Appends s to out as a json string, escaped like json::dump. Throws
+// if s is not valid UTF-8.
+void append_json_string(std::string& out, std::string_view s);
+
+// Writes to out the json string s, given without quotes, with its
+// escape sequences decoded. Throws on invalid escape sequences.
+void unescape_json_string(std::string_view s, std::string& out);
+
+// Returns true if json::parse accepts text. Nesting is limited like in
+// app_msg::parse.
+bool is_json(std::string_view text) noexcept;
+
+// The top-level fields of a json object, read without building a json
+// document. Keys and values are views of the parsed text, which must
+// outlive them. Nested objects and arrays are validated but not
+// decoded, their text can be parsed later, see raw.
+//
+// Strings with escape sequences are decoded into buffers owned by the
+// object, so that reusing it for many messages does not allocate.
+class app_msg {
+public:
+   static constexpr int max_fields = 16;
+
+private:
+   struct field {
+      std::string_view key;
+
+      // The json text of the value, strings with their quotes.
+      std::string_view value;
+   };
+
+   std::string_view text_;
+   std::array<field, max_fields> fields_;
+   std::array<std::string, max_fields> decoded_;
+   int size_ = 0;
+   app_cmd cmd_ = app_cmd::unknown;
+
+   // Returns the index of the field with the key or -1.
+   int find(std::string_view key) const noexcept;
+
+   // Returns the index of the field or throws if there is none.
+   int at(std::string_view key) const;
+
+public:
+   // Parses the object in text. Returns false if text is not valid
+   // json, as json::parse tells, is not an object or has more than
+   // max_fields fields. Also rejects duplicate keys and keys with
+   // escape sequences, so that every field has a single value that
+   // is both read and forwarded.
+   bool parse(std::string_view text);
+
+   // The command in the cmd field.
+   auto cmd() const noexcept { return cmd_; }
+
+   bool contains(std::string_view key) const noexcept
+      { return find(key) >= 0; }
+
+   // Returns the json text of the value. Throws if there is no such
+   // field.
+   std::string_view raw(std::string_view key) const;
+
+   // Returns the value of a string field. Throws if there is no such
+   // field or it is not a string.
+   std::string_view get_string(std::string_view key);
+
+   // Returns the value of an integer field. Throws if there is no such
+   // field or it is not an integer.
+   int get_int(std::string_view key) const;
+
+   // Copies the parsed text to out with the values of the given fields
+   // replaced by json strings. Fields that are missing are added at
+   // the end of the object. The remaining bytes are copied verbatim.
+   void
+   rewrite(
+      std::initializer_list<std::pair<std::string_view, std::string_view>> fields,
+      std::string& out) const;
+};
+
+} // occase
@@ -0,0 +1,222 @@
+#include "bitmap.hpp"
+
+#include <iterator>
+#include <algorithm>
+
+namespace occase
+{
+
+bool bitmap::chunk::contains(std::uint16_t low) const noexcept
+{
+   if (is_bitset())
+      return (bits[low / 64] >> (low % 64)) & 1;
+
+   return std::binary_search(std::cbegin(array), std::cend(array), low);
+}
+
+bool bitmap::chunk::add(std::uint16_t low)
+{
+   if (is_bitset()) {
+      auto& w = bits[low / 64];
+      auto const mask = std::uint64_t {1} << (low % 64);
+      if (w & mask)
+         return false;
+
+      w |= mask;
+      ++cardinality;
+      return true;
+   }
+
+   auto const point =
+      std::lower_bound(std::begin(array), std::end(array), low);
+
+   if (point != std::end(array) && *point == low)
+      return false;
+
+   array.insert(point, low);
+   ++cardinality;
+
+   if (std::ssize(array) > array_max) {
+      bits.resize(bitset_words);
+      for (auto v : array)
+         bits[v / 64] |= std::uint64_t {1} << (v % 64);
+
+      array = {};
+   }
+
+   return true;
+}
+
+bool bitmap::chunk::remove(std::uint16_t low)
+{
+   if (is_bitset()) {
+      auto& w = bits[low / 64];
+      auto const mask = std::uint64_t {1} << (low % 64);
+      if (!(w & mask))
+         return false;
+
+      w &= ~mask;
+      --cardinality;
+
+      if (cardinality < array_min) {
+         std::vector<std::uint16_t> tmp;
+         tmp.reserve(cardinality);
+         for (auto i = 0U; i < bitset_words; ++i) {
+            auto word = bits[i];
+            while (word != 0) {
+               tmp.push_back(i * 64 + __builtin_ctzll(word));
+               word &= word - 1;
+            }
+         }
+
+         array = std::move(tmp);
+         bits = {};
+      }
+
+      return true;
+   }
+
+   auto const point =
+      std::lower_bound(std::begin(array), std::end(array), low);
+
+   if (point == std::end(array) || *point != low)
+      return false;
+
+   array.erase(point);
+   --cardinality;
+   return true;
+}
+
+std::vector<bitmap::chunk>::iterator
+bitmap::lower_bound(std::uint16_t key)
+{
+   auto comp = [](auto const& c, auto key)
+      { return c.key < key; };
+
+   return std::lower_bound(std::begin(chunks_), std::end(chunks_), key, comp);
+}
+
+std::vector<bitmap::chunk>::const_iterator
+bitmap::lower_bound(std::uint16_t key) const
+{
+   auto comp = [](auto const& c, auto key)
+      { return c.key < key; };
+
+   return std::lower_bound(std::cbegin(chunks_), std::cend(chunks_), key, comp);
+}
+
+bool bitmap::add(value_type v)
+{
+   std::uint16_t const key = v >> 16;
+
+   auto point = lower_bound(key);
+   if (point == std::end(chunks_) || point->key != key)
+      point = chunks_.insert(point, chunk {key});
+
+   if (!point->add(v & 0xffff))
+      return false;
+
+   ++cardinality_;
+   return true;
+}
+
+bool bitmap::remove(value_type v)
+{
+   std::uint16_t const key = v >> 16;
+
+   auto const point = lower_bound(key);
+   if (point == std::end(chunks_) || point->key != key)
+      return false;
+
+   if (!point->remove(v & 0xffff))
+      return false;
+
+   if (point->cardinality == 0)
+      chunks_.erase(point);
+
+   --cardinality_;
+   return true;
+}
+
+bool bitmap::contains(value_type v) const noexcept
+{
+   std::uint16_t const key = v >> 16;
+
+   auto const point = lower_bound(key);
+   if (point == std::cend(chunks_) || point->key != key)
+      return false;
+
+   return point->contains(v & 0xffff);
+}
+
+bitmap::chunk bitmap::intersect(chunk const& a, chunk const& b)
+{
+   chunk ret {a.key};
+
+   if (a.is_bitset() && b.is_bitset()) {
+      std::vector<std::uint64_t> bits(bitset_words);
+      for (auto i = 0U; i < bitset_words; ++i) {
+         bits[i] = a.bits[i] & b.bits[i];
+         ret.cardinality += __builtin_popcountll(bits[i]);
+      }
+
+      if (ret.cardinality > array_max) {
+         ret.bits = std::move(bits);
+         return ret;
+      }
+
+      for (auto i = 0U; i < bitset_words; ++i) {
+         auto w = bits[i];
+         while (w != 0) {
+            ret.array.push_back(i * 64 + __builtin_ctzll(w));
+            w &= w - 1;
+         }
+      }
+
+      return ret;
+   }
+
+   if (a.is_bitset() || b.is_bitset()) {
+      auto const& arr = a.is_bitset() ? b : a;
+      auto const& set = a.is_bitset() ? a : b;
+      for (auto v : arr.array) {
+         if (set.contains(v))
+            ret.array.push_back(v);
+      }
+   } else {
+      std::set_intersection(
+         std::cbegin(a.array), std::cend(a.array),
+         std::cbegin(b.array), std::cend(b.array),
+         std::back_inserter(ret.array));
+   }
+
+   ret.cardinality = std::ssize(ret.array);
+   return ret;
+}
+
+bitmap operator&(bitmap const& a, bitmap const& b)
+{
+   bitmap ret;
+
+   auto i = std::cbegin(a.chunks_);
+   auto j = std::cbegin(b.chunks_);
+   while (i != std::cend(a.chunks_) && j != std::cend(b.chunks_)) {
+      if (i->key < j->key) {
+         ++i;
+      } else if (j->key < i->key) {
+         ++j;
+      } else {
+         auto c = bitmap::intersect(*i, *j);
+         if (c.cardinality != 0) {
+            ret.cardinality_ += c.cardinality;
+            ret.chunks_.push_back(std::move(c));
+         }
+         ++i;
+         ++j;
+      }
+   }
+
+   return ret;
+}
+
+} // occase
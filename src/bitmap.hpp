@@ -0,0 +1,112 @@
+#pragma once
+
+#include <vector>
+#include <cstdint>
+#include <iterator>
+#include <algorithm>
+
+namespace occase {
+
+// Compressed bitmap of 32-bit integers in the spirit of roaring
+// bitmaps. The integers are split in chunks according to their high
+// 16 bits. A chunk stores the low 16 bits either in a sorted array,
+// when it is sparse, or in a bitset of 2^16 bits when it is dense.
+class bitmap {
+public:
+   using value_type = std::uint32_t;
+
+private:
+   // Above this cardinality a chunk uses a bitset.
+   static constexpr int array_max = 4096;
+
+   // Below this cardinality a bitset goes back to an array. The gap
+   // keeps a chunk around array_max from converting on every add and
+   // remove.
+   static constexpr int array_min = array_max - 512;
+   static constexpr std::size_t bitset_words = (1 << 16) / 64;
+
+   struct chunk {
+      std::uint16_t key;
+      int cardinality = 0;
+
+      // Only one of these is used at a time.
+      std::vector<std::uint16_t> array;
+      std::vector<std::uint64_t> bits;
+
+      bool is_bitset() const noexcept { return !std::empty(bits); }
+      bool contains(std::uint16_t low) const noexcept;
+      bool add(std::uint16_t low);
+      bool remove(std::uint16_t low);
+   };
+
+   // Sorted by key.
+   std::vector<chunk> chunks_;
+   std::size_t cardinality_ = 0;
+
+   std::vector<chunk>::iterator lower_bound(std::uint16_t key);
+   std::vector<chunk>::const_iterator lower_bound(std::uint16_t key) const;
+
+   static chunk intersect(chunk const& a, chunk const& b);
+
+public:
+   // Adds v to the set. Returns false if it is already present.
+   bool add(value_type v);
+
+   // Removes v from the set. Returns false if it is not present.
+   bool remove(value_type v);
+
+   bool contains(value_type v) const noexcept;
+
+   auto size() const noexcept { return cardinality_; }
+   auto empty() const noexcept { return cardinality_ == 0; }
+
+   // Calls f on each element in ascending order.
+   template <class F>
+   void for_each(F f) const
+   {
+      auto g = [&](auto v)
+         { f(v); return true; };
+
+      for_each(0, g);
+   }
+
+   // Calls f on each element not less than from in ascending order
+   // until f returns false.
+   template <class F>
+   void for_each(value_type from, F f) const
+   {
+      for (auto iter = lower_bound(from >> 16); iter != std::cend(chunks_); ++iter) {
+         auto const& c = *iter;
+         value_type const high = value_type(c.key) << 16;
+         value_type const low = c.key == (from >> 16) ? from & 0xffff : 0;
+
+         if (c.is_bitset()) {
+            for (auto i = low / 64; i < bitset_words; ++i) {
+               auto w = c.bits[i];
+               if (i == low / 64)
+                  w &= ~std::uint64_t {0} << (low % 64);
+
+               while (w != 0) {
+                  if (!f(high | (i * 64 + __builtin_ctzll(w))))
+                     return;
+
+                  w &= w - 1;
+               }
+            }
+         } else {
+            auto const first =
+               std::lower_bound(std::cbegin(c.array), std::cend(c.array), low);
+
+            for (auto v = first; v != std::cend(c.array); ++v) {
+               if (!f(high | *v))
+                  return;
+            }
+         }
+      }
+   }
+
+   // Returns the intersection of both sets.
+   friend bitmap operator&(bitmap const& a, bitmap const& b);
+};
+
+} // occase
@@ -1,74 +1,221 @@
 #include "channel.hpp"
 
 #include <string>
+#include <string_view>
+#include <unordered_set>
 #include <chrono>
 #include <vector>
+#include <limits>
+#include <tuple>
+#include <utility>
 #include <iterator>
+#include <stdexcept>
+#include <functional>
 #include <algorithm>
 
 #include "post.hpp"
+#include "kernels.hpp"
 
 namespace occase
 {
 
-post channel::get(std::string const& id) const
+slot_type const* channel::find_id(std::string const& id) const
 {
-   post tmp;
-   tmp.id = id;
+   auto const match = ids_.find(id);
+   if (match == std::cend(ids_))
+      return nullptr;
 
-   auto point =
-      std::lower_bound(std::cbegin(posts_),
-		       std::cend(posts_),
-		       tmp,
-		       comp_post_id_less {});
+   return &match->second;
+}
 
-   if (point == std::cend(posts_))
+post channel::get(std::string const& id) const
+{
+   auto const match = find_id(id);
+   if (!match)
       return {};
 
-   return *point;
+   return posts_[*match].decode(hosts_);
 }
 
 void channel::add_post(post p)
 {
-   posts_.push_back(std::move(p));
+   insert(p);
+   counter_.add(p.location, p.product, 1, ++generation_);
+}
+
+slot_type channel::insert(post const& item)
+{
+   slot_type slot;
+   if (std::empty(free_slots_)) {
+      slot = std::size(posts_);
+      posts_.push_back(compact_post {item, hosts_, *strings_});
+   } else {
+      slot = free_slots_.back();
+      free_slots_.pop_back();
+      posts_[slot] = compact_post {item, hosts_, *strings_};
+   }
+
+   ids_[item.id] = slot;
+   locations_.insert(item.location, slot);
+   products_.insert(item.product, slot);
+
+   for (auto i = 0; i < std::ssize(item.ex_details); ++i)
+      details_[{i, item.ex_details[i]}].add(slot);
+
+   if (std::size(features_) < std::size(item.in_details))
+      features_.resize(std::size(item.in_details));
+
+   for (auto i = 0U; i < std::size(features_); ++i) {
+      auto& column = features_[i];
+      column.resize(std::size(posts_));
+      column[slot] = i < std::size(item.in_details) ? item.in_details[i] : 0;
+   }
+
+   if (std::size(ranges_) < std::size(item.range_values))
+      ranges_.resize(std::size(item.range_values));
+
+   for (auto i = 0U; i < std::size(item.range_values); ++i)
+      ranges_[i].insert({item.range_values[i], slot});
 
-   auto prev = std::prev(std::end(posts_));
+   auto const n = std::size(posts_);
 
-   // Sorted insertion according to the post id.
-   auto point =
-      std::upper_bound(std::begin(posts_),
-		       prev,
-		       *prev,
-		       comp_post_id_less {});
+   location_codes_.resize(n);
+   product_codes_.resize(n);
+   range_sizes_.resize(n);
+   dates_.resize(n);
+   visualizations_.resize(n);
 
-   std::rotate(point, prev, std::end(posts_));
+   location_codes_[slot] = pack(item.location);
+   product_codes_[slot] = pack(item.product);
+   range_sizes_[slot] = std::size(item.range_values);
+   dates_[slot] = item.date.count();
+   visualizations_[slot] = item.visualizations;
+
+   if (std::size(detail_columns_) < std::size(item.ex_details))
+      detail_columns_.resize(std::size(item.ex_details));
+
+   for (auto i = 0U; i < std::size(detail_columns_); ++i) {
+      auto& column = detail_columns_[i];
+      column.resize(n, -1);
+      column[slot] = i < std::size(item.ex_details) ? item.ex_details[i] : -1;
+   }
+
+   if (std::size(range_columns_) < std::size(item.range_values))
+      range_columns_.resize(std::size(item.range_values));
+
+   for (auto i = 0U; i < std::size(range_columns_); ++i) {
+      auto& column = range_columns_[i];
+      column.resize(n);
+      column[slot] = i < std::size(item.range_values) ? item.range_values[i] : 0;
+   }
+
+   by_date_.insert({item.date.count(), slot});
+   by_visualizations_.insert({item.visualizations, slot});
+   return slot;
+}
+
+void channel::load(std::vector<post> posts)
+{
+   // Sorts the positions instead of the posts, which are expensive to
+   // move.
+   std::vector<std::pair<date_type, std::size_t>> order;
+   order.reserve(std::size(posts));
+   for (auto i = 0U; i < std::size(posts); ++i)
+      order.push_back({posts[i].date, i});
+
+   std::sort(std::begin(order), std::end(order));
+
+   channel tmp;
+   tmp.strings_ = strings_;
+   tmp.generation_ = generation_ + 1;
+   tmp.posts_.reserve(std::size(posts));
+   tmp.ids_.reserve(std::size(posts));
+   for (auto const& e : order)
+      tmp.insert(posts[e.second]);
+
+   // The counters are built in (location, product) order, adding
+   // equal pairs at once, so that consecutive updates walk mostly
+   // the same nodes.
+   std::vector<post const*> codes;
+   codes.reserve(std::size(posts));
+   for (auto const& p : posts)
+      codes.push_back(&p);
+
+   auto comp = [](auto const* a, auto const* b)
+      { return std::tie(a->location, a->product) < std::tie(b->location, b->product); };
+
+   std::sort(std::begin(codes), std::end(codes), comp);
+
+   for (auto i = 0U; i < std::size(codes);) {
+      auto j = i + 1;
+      while (j < std::size(codes) && !comp(codes[i], codes[j]))
+         ++j;
+
+      tmp.counter_.add(codes[i]->location, codes[i]->product, j - i, tmp.generation_);
+      i = j;
+   }
+
+   // Marks the root as changed even when there are no posts.
+   tmp.counter_.add({}, {}, 0, tmp.generation_);
+
+   *this = std::move(tmp);
+}
+
+std::vector<std::string>
+channel::reconcile(std::vector<std::string> const& ids)
+{
+   std::unordered_set<std::string_view> const keep
+      {std::cbegin(ids), std::cend(ids)};
+
+   std::vector<slot_type> stale;
+   for (auto const& e : ids_) {
+      if (!keep.contains(e.first))
+         stale.push_back(e.second);
+   }
+
+   for (auto slot : stale)
+      erase(slot);
+
+   std::vector<std::string> missing;
+   for (auto const& id : ids) {
+      if (!find_id(id))
+         missing.push_back(id);
+   }
+
+   return missing;
 }
 
 std::vector<post>
 channel::remove_expired_posts(
    std::chrono::seconds now,
-   std::chrono::seconds exp)
+   std::chrono::seconds exp,
+   int max)
 {
-   // We have to traverse all posts as they are not sorted according
-   // to date.
+   // The oldest posts come first in by_date_, so only expired posts
+   // are visited.
+   std::vector<post> ret;
+   while (!std::empty(by_date_) && std::ssize(ret) < max) {
+      auto const [date, slot] = *std::cbegin(by_date_);
+      if (now <= date_type {date} + exp)
+         break;
 
-   // Returns true when a post is expired.
-   //auto f = [this, exp, now](auto const& p)
-   //   { return (p.date + exp) < now; };
+      ret.push_back(erase(slot));
+   }
 
-   return std::vector<post>{};
+   return ret;
 }
 
 void channel::on_visualization(std::string const& post_id)
 {
-   // TODO: Why aren't we using lower_bound here?
-
-   auto f = [&post_id](auto const& p)
-      { return p.id == post_id; };
+   auto const match = find_id(post_id);
+   if (!match)
+      return;
 
-   auto match = std::find_if(std::begin(posts_), std::end(posts_), f);
-   if (match != std::end(posts_))
-      ++match->visualizations;
+   auto const n = visualizations_[*match];
+   by_visualizations_.erase({n, *match});
+   by_visualizations_.insert({n + 1, *match});
+   posts_[*match].set_visualizations(n + 1);
+   visualizations_[*match] = n + 1;
 }
 
 bool channel::remove_post(
@@ -76,20 +223,53 @@ bool channel::remove_post(
    std::string const& from,
    bool ignore_owner)
 {
-   auto f = [&](auto const& p)
-      { return p.id == id; };
-
-   auto match = std::find_if(std::begin(posts_), std::end(posts_), f);
+   auto const match = find_id(id);
+   if (!match)
+      return false;
 
-   if (match == std::end(posts_))
+   if (!ignore_owner && posts_[*match].from() != from)
       return false;
 
-   if (match->from == from || ignore_owner) {
-      posts_.erase(match);
-      return true;
+   erase(*match);
+   return true;
+}
+
+post channel::erase(slot_type slot)
+{
+   auto ret = posts_[slot].decode(hosts_);
+
+   // Different posts may have the same id, in which case the id may
+   // refer to another slot.
+   auto const match = ids_.find(ret.id);
+   if (match != std::end(ids_) && match->second == slot)
+      ids_.erase(match);
+
+   locations_.erase(ret.location, slot);
+   products_.erase(ret.product, slot);
+   counter_.add(ret.location, ret.product, -1, ++generation_);
+
+   auto const& details = ret.ex_details;
+   for (auto i = 0; i < std::ssize(details); ++i) {
+      auto const point = details_.find({i, details[i]});
+      point->second.remove(slot);
+      if (std::empty(point->second))
+         details_.erase(point);
    }
 
-   return false;
+   for (auto& column : features_)
+      column[slot] = 0;
+
+   auto const& values = ret.range_values;
+   for (auto i = 0U; i < std::size(values); ++i)
+      ranges_[i].erase({values[i], slot});
+
+   by_date_.erase({dates_[slot], slot});
+   by_visualizations_.erase({visualizations_[slot], slot});
+
+   // Releases the memory held by the slot.
+   posts_[slot] = {};
+   free_slots_.push_back(slot);
+   return ret;
 }
 
 bool is_child_of(
@@ -106,57 +286,662 @@ bool is_child_of(
    return i == std::size(wanted);
 }
 
-template <class Receiver>
-void filter(post const& p, post const& q, Receiver recv)
+bool has_details(post const& q)
 {
-   if (!is_child_of(p.location, q.location))
-      return;
+   auto f = [](auto v)
+      { return v >= 0; };
+
+   return std::any_of(std::cbegin(q.ex_details), std::cend(q.ex_details), f);
+}
+
+bool has_features(post const& q)
+{
+   auto f = [](auto v)
+      { return v != 0; };
+
+   return std::any_of(std::cbegin(q.in_details), std::cend(q.in_details), f);
+}
+
+bool has_ranges(post const& q)
+{
+   for (auto i = 0U; i + 1 < std::size(q.range_values); i += 2) {
+      if (q.range_values[i] <= q.range_values[i + 1])
+         return true;
+   }
+
+   return false;
+}
+
+// Returns true when the query has filters that are not covered by the
+// location and product counters.
+bool has_filters(post const& q)
+{
+   return has_details(q) || has_features(q) || has_ranges(q);
+}
+
+channel::packed_query channel::pack_query(post const& q)
+{
+   return
+   { pack(q.location)
+   , prefix_mask(std::size(q.location))
+   , pack(q.product)
+   , prefix_mask(std::size(q.product))
+   };
+}
+
+// Returns true if the packed code is a child of the packed prefix.
+// Codes that don't fit are decoded by unpack and compared level by
+// level. A prefix that doesn't fit can only be the prefix of codes
+// that don't fit either.
+template <class F>
+bool
+match_code(
+   packed_code code,
+   packed_code wanted,
+   packed_code mask,
+   F unpack,
+   std::vector<int> const& unpacked_wanted)
+{
+   if (code == packed_unfit)
+      return is_child_of(unpack(), unpacked_wanted);
+
+   return wanted != packed_unfit && ((code ^ wanted) & mask) == 0;
+}
+
+bool channel::match(slot_type slot, post const& q, packed_query const& pq) const
+{
+   auto const location = [&]
+      { return posts_[slot].location(); };
+
+   auto const product = [&]
+      { return posts_[slot].product(); };
+
+   if (!match_code(location_codes_[slot], pq.location, pq.location_mask, location, q.location))
+      return false;
+
+   if (!match_code(product_codes_[slot], pq.product, pq.product_mask, product, q.product))
+      return false;
+
+   for (auto i = 0U; i < std::size(q.ex_details); ++i) {
+      if (q.ex_details[i] < 0)
+         continue;
+
+      if (i >= std::size(detail_columns_) || detail_columns_[i][slot] != q.ex_details[i])
+         return false;
+   }
+
+   for (auto i = 0U; i < std::size(q.in_details); ++i) {
+      if (q.in_details[i] == 0)
+         continue;
+
+      if (i >= std::size(features_) || (features_[i][slot] & q.in_details[i]) == 0)
+         return false;
+   }
+
+   for (auto i = 0U; i + 1 < std::size(q.range_values); i += 2) {
+      auto const min = q.range_values[i];
+      auto const max = q.range_values[i + 1];
+      if (min > max)
+         continue;
+
+      auto const dim = i / 2;
+      if (dim >= range_sizes_[slot])
+         return false;
+
+      auto const v = range_columns_[dim][slot];
+      if (v < min || v > max)
+         return false;
+   }
+
+   return true;
+}
+
+// Returns the candidates for the query q, that is the smallest of the
+// index lists. Returns nullptr if no post can satisfy the query.
+code_index::list_type const*
+channel::candidates(post const& q) const
+{
+   auto const* a = locations_.find(q.location);
+   auto const* b = products_.find(q.product);
+
+   if (!a || !b)
+      return nullptr;
+
+   return std::size(*a) < std::size(*b) ? a : b;
+}
+
+// Returns the slots of the posts whose ex_details match the query,
+// i.e. the intersection of the bitmaps of each wanted value.
+// A single set is returned from the index itself, the intersection of
+// more sets is stored in tmp.
+bitmap const* channel::detail_slots(post const& q, bitmap& tmp) const
+{
+   std::vector<bitmap const*> sets;
+   for (auto i = 0; i < std::ssize(q.ex_details); ++i) {
+      if (q.ex_details[i] < 0)
+         continue;
+
+      auto const match = details_.find({i, q.ex_details[i]});
+      if (match == std::cend(details_))
+         return &tmp;
+
+      sets.push_back(&match->second);
+   }
+
+   // Starting from the smallest set keeps the intersections small.
+   auto comp = [](auto const* a, auto const* b)
+      { return std::size(*a) < std::size(*b); };
+
+   std::sort(std::begin(sets), std::end(sets), comp);
+
+   if (std::size(sets) == 1)
+      return sets.front();
+
+   tmp = *sets[0] & *sets[1];
+   for (auto i = 2U; i < std::size(sets) && !std::empty(tmp); ++i)
+      tmp = tmp & *sets[i];
+
+   return &tmp;
+}
+
+// Copies to out the slots in [begin, end) whose features match the
+// query.
+void
+channel::feature_slots(
+   post const& q,
+   slot_type const* begin,
+   slot_type const* end,
+   std::vector<slot_type>& out) const
+{
+   out.clear();
+
+   std::vector<slot_type> tmp;
+   for (auto i = 0U; i < std::size(q.in_details); ++i) {
+      if (q.in_details[i] == 0)
+         continue;
 
-   if (!is_child_of(p.product, q.product))
+      if (i >= std::size(features_)) {
+         out.clear();
+         return;
+      }
+
+      tmp.clear();
+      any_of(features_[i].data(), begin, end, q.in_details[i], tmp);
+      out.swap(tmp);
+
+      begin = out.data();
+      end = out.data() + std::size(out);
+   }
+}
+
+// Looks for the most selective range in the query and copies its
+// slots, sorted, to out. Ranges with more than limit posts are not
+// worth it and are abandoned as soon as that is known. Returns false
+// if no range is selective enough.
+bool
+channel::range_slots(
+   post const& q,
+   std::size_t limit,
+   std::vector<slot_type>& out) const
+{
+   auto found = false;
+   std::vector<slot_type> tmp;
+
+   for (auto i = 0U; i + 1 < std::size(q.range_values); i += 2) {
+      auto const min = q.range_values[i];
+      auto const max = q.range_values[i + 1];
+      if (min > max)
+         continue;
+
+      auto const dim = i / 2;
+      if (dim >= std::size(ranges_)) {
+         // No post has this dimension.
+         out.clear();
+         return true;
+      }
+
+      auto const& index = ranges_[dim];
+
+      tmp.clear();
+      auto iter = index.lower_bound({min, 0});
+      while (iter != std::cend(index) && iter->first <= max && std::size(tmp) <= limit) {
+         tmp.push_back(iter->second);
+         ++iter;
+      }
+
+      if (std::size(tmp) > limit)
+         continue;
+
+      // The next ranges have to be smaller than this one.
+      limit = std::size(tmp);
+      out.swap(tmp);
+      found = true;
+   }
+
+   if (found)
+      std::sort(std::begin(out), std::end(out));
+
+   return found;
+}
+
+template <class F>
+void channel::visit(post const& q, slot_type from, F f) const
+{
+   auto const* l = candidates(q);
+   if (!l)
       return;
 
-   recv(p);
+   auto const pq = pack_query(q);
+
+   // Returns false to stop the iteration.
+   auto g = [&](auto slot)
+      { return !match(slot, q, pq) || f(slot); };
+
+   auto const use_details = has_details(q);
+
+   bitmap tmp;
+   bitmap const* details = nullptr;
+   if (use_details) {
+      details = detail_slots(q, tmp);
+
+      // Iterates over the smallest of both sets.
+      if (std::size(*details) < std::size(*l)) {
+         details->for_each(from, g);
+         return;
+      }
+   }
+
+   // Narrows the candidates with the ranges when they are more
+   // selective than the location and product.
+   std::vector<slot_type> ranged;
+   auto const use_ranges =
+      has_ranges(q) && range_slots(q, std::size(*l), ranged);
+
+   auto next_ranged = std::cbegin(ranged);
+   auto const use_features = has_features(q);
+
+   // The candidates come from the index of one of the codes, the
+   // other one is checked in batches on its column.
+   auto const by_location = l == locations_.find(q.location);
+   auto const use_codes = !std::empty(by_location ? q.product : q.location);
+   auto const* codes = by_location ? product_codes_.data() : location_codes_.data();
+   auto const value = by_location ? pq.product : pq.location;
+   auto const mask = by_location ? pq.product_mask : pq.location_mask;
+
+   std::vector<slot_type> survivors;
+   std::vector<slot_type> coded;
+   std::vector<slot_type> featured;
+
+   // Called on each contiguous range of candidates.
+   auto h = [&](slot_type const* begin, slot_type const* end)
+   {
+      if (use_ranges) {
+         next_ranged = std::lower_bound(next_ranged, std::cend(ranged), *begin);
+         if (next_ranged == std::cend(ranged))
+            return false;
+
+         survivors.clear();
+         std::set_intersection(
+            begin, end,
+            next_ranged, std::cend(ranged),
+            std::back_inserter(survivors));
+
+         begin = survivors.data();
+         end = survivors.data() + std::size(survivors);
+      }
+
+      if (use_codes) {
+         coded.clear();
+         prefix_of(codes, begin, end, value, mask, coded);
+         begin = coded.data();
+         end = coded.data() + std::size(coded);
+      }
+
+      // Rejects posts by their features before reading them.
+      if (use_features) {
+         feature_slots(q, begin, end, featured);
+         begin = featured.data();
+         end = featured.data() + std::size(featured);
+      }
+
+      for (; begin != end; ++begin) {
+         if (use_details && !details->contains(*begin))
+            continue;
+
+         if (!g(*begin))
+            return false;
+      }
+
+      return true;
+   };
+
+   l->for_each_range(from, h);
 }
 
 std::vector<post> channel::query(post const& q, int max) const
+{
+   std::string cursor;
+   return query(q, max, cursor);
+}
+
+std::vector<post>
+channel::query(
+   post const& q,
+   int max,
+   std::string& cursor,
+   order_by by) const
 {
    std::vector<post> ret;
+   for (auto slot : query_slots(q, max, cursor, by))
+      ret.push_back(posts_[slot].decode(hosts_));
+
+   return ret;
+}
+
+void
+channel::query_json(
+   post const& q,
+   int max,
+   std::string& cursor,
+   order_by by,
+   std::string& out) const
+{
+   out.push_back('[');
+   for (auto slot : query_slots(q, max, cursor, by)) {
+      posts_[slot].write_json(hosts_, out);
+      out.push_back(',');
+   }
 
-   auto f = [&](post const& p)
-      { ret.push_back(p); };
+   if (out.back() == ',')
+      out.back() = ']';
+   else
+      out.push_back(']');
+}
+
+std::vector<slot_type>
+channel::query_slots(
+   post const& q,
+   int max,
+   std::string& cursor,
+   order_by by) const
+{
+   if (by != order_by::none)
+      return query_ordered(q, max, cursor, by);
+
+   std::vector<slot_type> ret;
+
+   slot_type from = 0;
+   if (!std::empty(cursor))
+      from = resume_from(cursor);
+
+   cursor.clear();
+   if (max <= 0)
+      return ret;
+
+   slot_type last = 0;
+   auto f = [&](auto slot)
+   {
+      if (std::ssize(ret) == max) {
+         // There are more posts, the next page starts after the last
+         // one returned.
+         cursor = std::to_string(last) + ":" + posts_[last].id();
+         return false;
+      }
 
-   auto g = [&](post const& p)
-      { filter(p, q, f); };
+      ret.push_back(slot);
+      last = slot;
+      return true;
+   };
 
-   std::for_each(std::cbegin(posts_), std::cend(posts_), g);
+   visit(q, from, f);
    return ret;
 }
 
+// The cursor has the form slot:id, where slot and id refer to the last
+// post in the previous page. The slot of a post may change (see
+// remove_post) so the id has precedence when it is still present.
+slot_type channel::resume_from(std::string const& cursor) const
+{
+   auto const pos = cursor.find(':');
+   if (pos == std::string::npos)
+      throw std::invalid_argument("Invalid cursor.");
+
+   auto const match = find_id(cursor.substr(pos + 1));
+   if (match)
+      return *match + 1;
+
+   return std::stoul(cursor.substr(0, pos)) + 1;
+}
+
+long channel::order_key(order_by by, slot_type slot) const
+{
+   if (by == order_by::date)
+      return dates_[slot];
+
+   return visualizations_[slot];
+}
+
+// For ordered queries the cursor has the form key:slot:id. The key of
+// the post may have changed in the meantime, e.g. its number of
+// visualizations, so the current one is used when the post exists.
+std::pair<long, slot_type>
+channel::resume_from(std::string const& cursor, order_by by) const
+{
+   auto const pos1 = cursor.find(':');
+   auto const pos2 = cursor.find(':', pos1 + 1);
+   if (pos1 == std::string::npos || pos2 == std::string::npos)
+      throw std::invalid_argument("Invalid cursor.");
+
+   auto const match = find_id(cursor.substr(pos2 + 1));
+   if (match)
+      return {order_key(by, *match), *match};
+
+   slot_type const slot = std::stoul(cursor.substr(pos1 + 1, pos2 - pos1 - 1));
+   return {std::stol(cursor.substr(0, pos1)), slot};
+}
+
+std::vector<slot_type>
+channel::query_ordered(
+   post const& q,
+   int max,
+   std::string& cursor,
+   order_by by) const
+{
+   using value_type = order_index::value_type;
+
+   std::vector<slot_type> ret;
+
+   // Only posts that come after this position in descending order are
+   // returned.
+   value_type pos
+   { std::numeric_limits<long>::max()
+   , std::numeric_limits<slot_type>::max()
+   };
+
+   if (!std::empty(cursor))
+      pos = resume_from(cursor, by);
+
+   cursor.clear();
+   if (max <= 0)
+      return ret;
+
+   auto const* l = candidates(q);
+   if (!l)
+      return ret;
+
+   auto const& index = by == order_by::date ? by_date_ : by_visualizations_;
+
+   // The best max + 1 posts in descending order. The extra one tells
+   // whether there is a next page.
+   std::vector<value_type> top;
+
+   // When the posts matching the location and product are a fraction
+   // r of all posts, walking the order index finds max posts after
+   // about max / r steps.
+   auto const walk = (std::size(index) / std::size(*l)) * (max + 1);
+
+   if (walk < std::size(*l)) {
+      auto const pq = pack_query(q);
+      auto iter = std::make_reverse_iterator(index.lower_bound(pos));
+      for (; iter != std::crend(index) && std::ssize(top) <= max; ++iter) {
+         if (match(iter->second, q, pq))
+            top.push_back(*iter);
+      }
+   } else {
+      // Keeps the best max + 1 posts in a min-heap.
+      auto const comp = std::greater<value_type>{};
+
+      auto f = [&](auto slot)
+      {
+         value_type const e {order_key(by, slot), slot};
+         if (!(e < pos))
+            return true;
+
+         if (std::ssize(top) <= max) {
+            top.push_back(e);
+            std::push_heap(std::begin(top), std::end(top), comp);
+         } else if (top.front() < e) {
+            std::pop_heap(std::begin(top), std::end(top), comp);
+            top.back() = e;
+            std::push_heap(std::begin(top), std::end(top), comp);
+         }
+
+         return true;
+      };
+
+      visit(q, 0, f);
+      std::sort_heap(std::begin(top), std::end(top), comp);
+   }
+
+   if (std::ssize(top) > max) {
+      top.pop_back();
+      auto const& last = top.back();
+      cursor = std::to_string(last.first)
+             + ":" + std::to_string(last.second)
+             + ":" + posts_[last.second].id();
+   }
+
+   for (auto const& e : top)
+      ret.push_back(e.second);
+
+   return ret;
+}
+
+channel::order_by to_order_by(std::string const& s)
+{
+   if (std::empty(s))
+      return channel::order_by::none;
+
+   if (s == "date")
+      return channel::order_by::date;
+
+   if (s == "visualizations")
+      return channel::order_by::visualizations;
+
+   throw std::invalid_argument("Invalid order_by.");
+}
+
 int channel::count(post const& q) const
 {
-   int ret;
+   if (!has_filters(q))
+      return counter_.count(q.location, q.product);
 
-   auto f = [&](post const&)
-      { ++ret; };
+   int ret = 0;
 
-   auto g = [&](post const& p)
-      { filter(p, q, f); };
+   auto f = [&](auto)
+      { ++ret; return true; };
 
-   std::for_each(std::cbegin(posts_), std::cend(posts_), g);
+   visit(q, 0, f);
    return ret;
 }
 
-void channel::load_visualizations(visual_type const& v)
+code_counter::facets channel::facets(post const& q) const
 {
-   auto vbegin = std::cbegin(v);
-   auto pbegin = std::begin(posts_);
+   if (!has_filters(q))
+      return counter_.get_facets(q.location, q.product);
 
-   while (vbegin != std::cend(v) && pbegin != std::end(posts_)) {
-      if (vbegin->first == pbegin->id) {
-	 pbegin->visualizations = vbegin->second;
-	 ++pbegin;
+   // Groups the matches by the code that follows the query prefix.
+   std::map<int, int> location;
+   std::map<int, int> product;
+
+   auto add = [](auto code, auto n, auto unpack, auto& counts)
+   {
+      if (code != packed_unfit) {
+         auto const v = unpack_level(code, n);
+         if (v >= 0)
+            ++counts[v];
+
+         return;
       }
-      ++vbegin;
+
+      auto const c = unpack();
+      if (std::size(c) > n)
+         ++counts[c[n]];
+   };
+
+   auto f = [&](auto slot)
+   {
+      auto const& p = posts_[slot];
+
+      add(location_codes_[slot], std::size(q.location),
+          [&]{ return p.location(); }, location);
+
+      add(product_codes_[slot], std::size(q.product),
+          [&]{ return p.product(); }, product);
+
+      return true;
+   };
+
+   visit(q, 0, f);
+
+   return
+   { {std::cbegin(location), std::cend(location)}
+   , {std::cbegin(product), std::cend(product)}
+   };
+}
+
+bool channel::compact()
+{
+   // Rebuilding is only worth it when most slots are free.
+   auto constexpr min_free = 1024U;
+   if (std::size(free_slots_) < min_free || 2 * size() > std::size(posts_))
+      return false;
+
+   std::vector<bool> is_free(std::size(posts_), false);
+   for (auto slot : free_slots_)
+      is_free[slot] = true;
+
+   // The relative order of the slots, and therefore of the posts with
+   // the same date or number of visualizations, is preserved.
+   channel tmp;
+   tmp.strings_ = strings_;
+   tmp.generation_ = generation_;
+   for (auto slot = 0U; slot < std::size(posts_); ++slot) {
+      if (!is_free[slot])
+         tmp.add_post(posts_[slot].decode(hosts_));
+   }
+
+   *this = std::move(tmp);
+   return true;
+}
+
+void channel::load_visualizations(visual_type const& v)
+{
+   // Redis returns the pairs in no particular order and posts without
+   // visualizations are absent. Unknown ids are posts removed in the
+   // meantime.
+   ++generation_;
+   for (auto const& [id, n] : v) {
+      auto const* match = find_id(id);
+      if (!match)
+         continue;
+
+      auto const slot = *match;
+      by_visualizations_.erase({visualizations_[slot], slot});
+      visualizations_[slot] = n;
+      by_visualizations_.insert({visualizations_[slot], slot});
+      posts_[slot].set_visualizations(n);
+      counter_.add(posts_[slot].location(), posts_[slot].product(), 0, generation_);
    }
 }
 
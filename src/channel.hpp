@@ -1,12 +1,21 @@
 #pragma once
 
+#include <map>
+#include <set>
 #include <string>
 #include <chrono>
+#include <memory>
 #include <vector>
+#include <cstdint>
 #include <utility>
 #include <algorithm>
+#include <unordered_map>
 
 #include "post.hpp"
+#include "bitmap.hpp"
+#include "code_index.hpp"
+#include "intern.hpp"
+#include "compact_post.hpp"
 
 namespace occase {
 
@@ -14,24 +23,184 @@ class channel {
 public:
    using visual_type = std::vector<std::pair<std::string, int>>;
 
+   // The order in which query returns posts. Except for none the
+   // posts come in descending order i.e. newest or most viewed first.
+   enum class order_by
+   { none
+   , date
+   , visualizations
+   };
+
 private:
-   // The posts sorted by their id.
-   std::vector<post> posts_;
+   // The post storage, indexed by slot. Slots of removed posts are
+   // kept in free_slots_ and reused on insertion, until compact
+   // releases them. Queries filter on the columns below and decode
+   // the posts only to return them.
+   std::vector<compact_post> posts_;
+   image_hosts hosts_;
+
+   // The author strings of the posts. Shared with the channels that
+   // replace this one on load and compact, and with the user sessions
+   // through intern.
+   std::shared_ptr<intern_table> strings_ = std::make_shared<intern_table>();
+   std::vector<slot_type> free_slots_;
+
+   // Maps the post id to its slot. When two posts have the same id
+   // the last one added wins.
+   std::unordered_map<std::string, slot_type> ids_;
+
+   // Indexes over the post location and product.
+   code_index locations_;
+   code_index products_;
+
+   // The number of posts per location and product prefix.
+   code_counter counter_;
+
+   // Incremented when posts are added or removed and when the
+   // visualizations are loaded, see generation.
+   std::uint64_t generation_ = 0;
+
+   // Inverted index from (position, value) pairs of post::ex_details
+   // to the slots of the posts that have them.
+   std::map<std::pair<int, int>, bitmap> details_;
+
+   // The post::in_details masks stored by column, i.e. features_[i]
+   // holds in_details[i] of all slots (zero when the post has fewer
+   // masks). Queries scan these columns before reading the posts.
+   std::vector<std::vector<code_type>> features_;
+
+   // The remaining filter fields stored by column and indexed by
+   // slot. The location and product are packed, see pack. A missing
+   // ex_details value is stored as -1, which no query value matches,
+   // and range_sizes_ holds the number of range_values of each post.
+   std::vector<packed_code> location_codes_;
+   std::vector<packed_code> product_codes_;
+   std::vector<std::vector<int>> detail_columns_;
+   std::vector<std::vector<int>> range_columns_;
+   std::vector<std::uint32_t> range_sizes_;
+   std::vector<long> dates_;
+   std::vector<int> visualizations_;
+
+   // One ordered index per dimension of post::range_values.
+   std::vector<std::set<std::pair<int, slot_type>>> ranges_;
+
+   // The (key, slot) pairs of all posts ordered by date and by number
+   // of visualizations.
+   using order_index = std::set<std::pair<long, slot_type>>;
+   order_index by_date_;
+   order_index by_visualizations_;
+
+   // Returns the slot of the post with the given id or nullptr if
+   // there is none.
+   slot_type const* find_id(std::string const& id) const;
+
+   // Stores the post and adds it to all indexes but the counters.
+   slot_type insert(post const& p);
+
+   // Removes the post from all indexes and returns it.
+   post erase(slot_type slot);
+
+   // The location and product of a query packed to be matched
+   // against the columns.
+   struct packed_query {
+      packed_code location;
+      packed_code location_mask;
+      packed_code product;
+      packed_code product_mask;
+   };
+
+   static packed_query pack_query(post const& q);
+
+   // Returns true if the post in the slot satisfies the query. Reads
+   // only the columns.
+   bool match(slot_type slot, post const& q, packed_query const& pq) const;
+
+   code_index::list_type const* candidates(post const& q) const;
+   bitmap const* detail_slots(post const& q, bitmap& tmp) const;
+
+   bool
+   range_slots(
+      post const& q,
+      std::size_t limit,
+      std::vector<slot_type>& out) const;
+
+   void
+   feature_slots(
+      post const& q,
+      slot_type const* begin,
+      slot_type const* end,
+      std::vector<slot_type>& out) const;
+
+   slot_type resume_from(std::string const& cursor) const;
+
+   long order_key(order_by by, slot_type slot) const;
+
+   std::pair<long, slot_type>
+   resume_from(std::string const& cursor, order_by by) const;
+
+   std::vector<slot_type>
+   query_slots(
+      post const& q,
+      int max,
+      std::string& cursor,
+      order_by by) const;
+
+   std::vector<slot_type>
+   query_ordered(
+      post const& q,
+      int max,
+      std::string& cursor,
+      order_by by) const;
+
+   // Calls f with the slot of each post that satisfies the query in
+   // ascending slot order, starting at slot from. The iteration stops
+   // when f returns false.
+   template <class F>
+   void visit(post const& q, slot_type from, F f) const;
 
 public:
    // Adds a new post.
    void add_post(post p);
 
+   // Replaces the content of the channel with the posts. They are
+   // sorted by date once and stored in that order, so that the
+   // indexes are built by appending.
+   void load(std::vector<post> posts);
+
+   // Removes the posts whose id is not in ids and returns the ids
+   // that are not in the channel. Used to bring the channel up to
+   // date with the posts key in redis.
+   std::vector<std::string> reconcile(std::vector<std::string> const& ids);
+
+   // Calls f on each post in ascending date order.
+   template <class F>
+   void for_each(F f) const
+   {
+      for (auto const& e : by_date_)
+         f(posts_[e.second].decode(hosts_));
+   }
+
+   // Interns the string in the table of the post authors.
+   interned_string intern(std::string_view s)
+      { return strings_->intern(s); }
+
+   // Returns the number of distinct interned strings.
+   auto interned_size() const noexcept
+      { return std::size(*strings_); }
+
    // Returns the post with the requested id.
    post get(std::string const& id) const;
 
-   // Removes and returns expired posts.
+   // Removes and returns at most max expired posts, oldest first. The
+   // cost is proportional to the number of posts removed.
    std::vector<post>
    remove_expired_posts(
       std::chrono::seconds now,
-      std::chrono::seconds exp);
+      std::chrono::seconds exp,
+      int max);
 
-   // Increases the number of visualizations of a post by one.
+   // Increases the number of visualizations of a post by one. Doesn't
+   // change the generation.
    void on_visualization(std::string const& post_id);
 
    // Removes a post if it exists and from matches the post author.
@@ -44,22 +213,93 @@ public:
       bool ignore_owner);
 
    // Returns the number of posts.
-   auto size() const noexcept { return std::size(posts_); }
+   auto size() const noexcept
+      { return std::size(posts_) - std::size(free_slots_); }
+
+   // Moves the posts to the front of the storage and rebuilds the
+   // indexes when most slots are free. This is expensive and should
+   // be called when the server is otherwise idle. Returns true when
+   // the channel was compacted.
+   bool compact();
 
    // Returns to posts that satisfy the query. max refers to the
-   // maximum number of posts that should be returned.
+   // maximum number of posts that should be returned. The order of
+   // the posts is unspecified.
+   //
+   // A post satisfies the query when its location and product are
+   // children of the query location and product, its ex_details
+   // have the same value as the query ex_details and its in_details
+   // have any of the bits set in the query in_details and its
+   // range_values lie inside the query ranges. Negative values in the
+   // query ex_details and zero masks in the query in_details match
+   // any value.
+   //
+   // The query range_values hold inclusive (min, max) pairs, one per
+   // dimension of the post range_values, e.g. {0, 100, 2010, 2020}.
+   // Pairs with min > max match any value.
    std::vector<post> query(post const& p, int max = 300) const;
 
-   // Counts the number of posts that satisfy the query.
+   // Like above but returns the page that follows cursor, which is
+   // then updated to point to the next page. It is cleared on the
+   // last page. Pass an empty cursor to start from the beginning.
+   //
+   // When an order is given only the max best posts are selected,
+   // either by walking the order index until max posts match or by
+   // keeping the best ones while visiting the matches, whatever is
+   // expected to be cheaper.
+   std::vector<post>
+   query(
+      post const& p,
+      int max,
+      std::string& cursor,
+      order_by by = order_by::none) const;
+
+   // Like above but appends the posts to out as a json array, with the
+   // same bytes as json(query(p, max, cursor, by)).dump(). The posts
+   // are written from their compact encoding without being decoded.
+   void
+   query_json(
+      post const& p,
+      int max,
+      std::string& cursor,
+      order_by by,
+      std::string& out) const;
+
+   // Counts the number of posts that satisfy the query. It costs
+   // O(depth) of the location and product codes when the query has
+   // no ex_details, in_details or range_values.
    int count(post const& p) const;
 
+   // Counts the posts that satisfy the query grouped by the next
+   // level of the location and product codes.
+   code_counter::facets facets(post const& p) const;
+
+   // Returns the generation of the channel, that grows when posts are
+   // added or removed and when the visualizations are loaded. Single
+   // visualizations don't change it, so that views don't invalidate
+   // cached counts and searches.
+   auto generation() const noexcept { return generation_; }
+
+   // Returns the generation of the last change to the posts whose
+   // location and product are children of the query location and
+   // product, see generation(). The results of a query computed at
+   // generation g are still valid as long as this is not greater
+   // than g, except for their number of visualizations.
+   std::uint64_t generation(post const& q) const
+      { return counter_.generation(q.location, q.product); }
+
    // Loads the visualizations in the posts. The expected format is
    //
    // {post_id1, n1}, {post_id2, n2} ...
    //
-   // where the keys are strings and the values integers.
+   // where the keys are strings and the values integers, in any
+   // order. Posts that are not listed keep their visualizations.
    void load_visualizations(visual_type const & v);
 };
 
+// Converts "date" and "visualizations" to the respective order. The
+// empty string means order_by::none. Throws on other values.
+channel::order_by to_order_by(std::string const& s);
+
 }
 
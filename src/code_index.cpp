@@ -0,0 +1,227 @@
+#include "code_index.hpp"
+
+#include <iterator>
+#include <algorithm>
+
+namespace occase
+{
+
+packed_code pack(std::vector<int> const& code)
+{
+   if (std::ssize(code) > packed_levels)
+      return packed_unfit;
+
+   packed_code ret = 0;
+   for (auto i = 0; i < std::ssize(code); ++i) {
+      if (code[i] < 0 || code[i] > packed_value_max)
+         return packed_unfit;
+
+      ret |= packed_code(code[i] + 1) << (64 - (i + 1) * packed_level_bits);
+   }
+
+   return ret;
+}
+
+int unpack_level(packed_code code, std::size_t n) noexcept
+{
+   if (n >= packed_levels)
+      return -1;
+
+   auto const shift = 64 - (n + 1) * packed_level_bits;
+   return int((code >> shift) & ((1 << packed_level_bits) - 1)) - 1;
+}
+
+packed_code prefix_mask(std::size_t n) noexcept
+{
+   if (n == 0)
+      return 0;
+
+   if (n > packed_levels)
+      n = packed_levels;
+
+   return ~packed_code {0} << (64 - n * packed_level_bits);
+}
+
+void code_index::insert(std::vector<int> const& code, slot_type slot)
+{
+   auto* n = &root_;
+   n->slots.insert(slot);
+
+   for (auto c : code) {
+      n = &n->children[c];
+      n->slots.insert(slot);
+   }
+}
+
+void code_index::erase(std::vector<int> const& code, slot_type slot)
+{
+   auto* n = &root_;
+   n->slots.erase(slot);
+
+   for (auto c : code) {
+      auto const match = n->children.find(c);
+      if (match == std::end(n->children))
+         return;
+
+      match->second.slots.erase(slot);
+
+      // When a node becomes empty so does its subtree.
+      if (std::empty(match->second.slots)) {
+         n->children.erase(match);
+         return;
+      }
+
+      n = &match->second;
+   }
+}
+
+code_index::list_type const*
+code_index::find(std::vector<int> const& prefix) const
+{
+   auto const* n = &root_;
+   for (auto c : prefix) {
+      auto const match = n->children.find(c);
+      if (match == std::cend(n->children))
+         return nullptr;
+
+      n = &match->second;
+   }
+
+   if (std::empty(n->slots))
+      return nullptr;
+
+   return &n->slots;
+}
+
+void code_counter::add_product(
+   product_node& root,
+   std::vector<int> const& product,
+   int n,
+   std::uint64_t generation)
+{
+   root.count += n;
+   root.generation = generation;
+
+   auto* node = &root;
+   for (auto c : product) {
+      auto& child = node->children[c];
+      child.count += n;
+      child.generation = generation;
+
+      if (child.count == 0) {
+         node->children.erase(c);
+         return;
+      }
+
+      node = &child;
+   }
+}
+
+void code_counter::add(
+   std::vector<int> const& location,
+   std::vector<int> const& product,
+   int n,
+   std::uint64_t generation)
+{
+   add_product(root_.products, product, n, generation);
+
+   auto* node = &root_;
+   for (auto c : location) {
+      auto& child = node->children[c];
+      add_product(child.products, product, n, generation);
+
+      if (child.products.count == 0) {
+         node->children.erase(c);
+         return;
+      }
+
+      node = &child;
+   }
+}
+
+namespace
+{
+
+template <class Node>
+Node const* find_node(Node const* n, std::vector<int> const& code)
+{
+   for (auto c : code) {
+      auto const match = n->children.find(c);
+      if (match == std::cend(n->children))
+         return nullptr;
+
+      n = &match->second;
+   }
+
+   return n;
+}
+
+// Like find_node but returns the deepest node on the path of code.
+template <class Node>
+Node const* find_nearest(Node const* n, std::vector<int> const& code)
+{
+   for (auto c : code) {
+      auto const match = n->children.find(c);
+      if (match == std::cend(n->children))
+         break;
+
+      n = &match->second;
+   }
+
+   return n;
+}
+
+}
+
+int code_counter::count(
+   std::vector<int> const& location,
+   std::vector<int> const& product) const
+{
+   auto const* l = find_node(&root_, location);
+   if (!l)
+      return 0;
+
+   auto const* p = find_node(&l->products, product);
+   if (!p)
+      return 0;
+
+   return p->count;
+}
+
+code_counter::facets
+code_counter::get_facets(
+   std::vector<int> const& location,
+   std::vector<int> const& product) const
+{
+   facets ret;
+
+   auto const* l = find_node(&root_, location);
+   if (!l)
+      return ret;
+
+   for (auto const& child : l->children) {
+      auto const* p = find_node(&child.second.products, product);
+      if (p)
+         ret.location.push_back({child.first, p->count});
+   }
+
+   auto const* p = find_node(&l->products, product);
+   if (!p)
+      return ret;
+
+   for (auto const& child : p->children)
+      ret.product.push_back({child.first, child.second.count});
+
+   return ret;
+}
+
+std::uint64_t
+code_counter::generation(
+   std::vector<int> const& location,
+   std::vector<int> const& product) const
+{
+   auto const* l = find_nearest(&root_, location);
+   return find_nearest(&l->products, product)->generation;
+}
+
+} // occase
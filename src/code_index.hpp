@@ -0,0 +1,144 @@
+#pragma once
+
+#include <map>
+#include <vector>
+#include <cstdint>
+#include <utility>
+
+#include "slot_list.hpp"
+
+namespace occase {
+
+// A code like post::location packed in 64 bits. Levels are stored from
+// the most significant bits down in fields of packed_level_bits bits,
+// each holding the level value plus one so that zero means the level
+// is absent. Codes with more than packed_levels levels or values
+// outside [0, packed_value_max] don't fit and are packed as
+// packed_unfit, whose lowest bit is never set by a code that fits.
+using packed_code = std::uint64_t;
+
+constexpr int packed_levels = 4;
+constexpr int packed_level_bits = 15;
+constexpr int packed_value_max = (1 << packed_level_bits) - 2;
+constexpr packed_code packed_unfit = 1;
+
+packed_code pack(std::vector<int> const& code);
+
+// Returns the value of the level n of a code that fits or -1 if the
+// code has fewer levels.
+int unpack_level(packed_code code, std::size_t n) noexcept;
+
+// Returns the mask that selects the first n levels of a packed code.
+// A packed code c is a child of the packed prefix p with n levels when
+//
+//    ((c ^ p) & prefix_mask(n)) == 0
+//
+packed_code prefix_mask(std::size_t n) noexcept;
+
+// Hierarchical index over codes like post::location and
+// post::product. A code like {1, 2, 3} is stored in the path
+//
+//    root --> 1 --> 2 --> 3
+//
+// and every node on the path holds the slot of the post. This way the
+// posts that are children of a prefix are found by walking down
+// std::size(prefix) levels instead of scanning all posts.
+class code_index {
+public:
+   using list_type = slot_list;
+
+private:
+   struct node {
+      list_type slots;
+      std::map<int, node> children;
+   };
+
+   node root_;
+
+public:
+   // Adds the slot to all nodes on the path of code.
+   void insert(std::vector<int> const& code, slot_type slot);
+
+   // Removes the slot from all nodes on the path of code. Nodes that
+   // become empty are released.
+   void erase(std::vector<int> const& code, slot_type slot);
+
+   // Returns the slots of all posts whose code is a child of prefix
+   // or nullptr if there is none.
+   list_type const* find(std::vector<int> const& prefix) const;
+};
+
+// Keeps the number of posts for each (location prefix, product
+// prefix) pair. Each location node holds a tree of product counters
+// so that a count is answered by walking down both codes.
+//
+// Every counter also holds the generation of its last change, so
+// that results computed for a pair of prefixes can be told apart from
+// stale ones without looking at the rest of the tree.
+class code_counter {
+public:
+   // Pairs of (code, number of posts).
+   using facet_type = std::vector<std::pair<int, int>>;
+
+   struct facets {
+      facet_type location;
+      facet_type product;
+   };
+
+private:
+   struct product_node {
+      int count = 0;
+      std::uint64_t generation = 0;
+      std::map<int, product_node> children;
+   };
+
+   struct location_node {
+      product_node products;
+      std::map<int, location_node> children;
+   };
+
+   location_node root_;
+
+   static void
+   add_product(
+      product_node& root,
+      std::vector<int> const& product,
+      int n,
+      std::uint64_t generation);
+
+public:
+   // Adds n to the counters of all prefix pairs of location and
+   // product and sets their generation. Use n = -1 on removal and
+   // n = 0 to only mark the pairs as changed. Counters that drop to
+   // zero are released.
+   void
+   add(std::vector<int> const& location,
+       std::vector<int> const& product,
+       int n,
+       std::uint64_t generation);
+
+   // Returns the number of posts whose location and product are
+   // children of the given prefixes.
+   int
+   count(std::vector<int> const& location,
+         std::vector<int> const& product) const;
+
+   // Returns the number of posts in each child of the location
+   // prefix (restricted to the product prefix) and in each child of
+   // the product prefix (restricted to the location prefix).
+   facets
+   get_facets(
+      std::vector<int> const& location,
+      std::vector<int> const& product) const;
+
+   // Returns the generation of the last change to the posts whose
+   // location and product are children of the given prefixes. When
+   // the pair has no posts it is the generation of the nearest pair
+   // of ancestors, which changes when the pair gets posts again.
+   std::uint64_t
+   generation(
+      std::vector<int> const& location,
+      std::vector<int> const& product) const;
+};
+
+} // occase
@@ -0,0 +1,479 @@
+#include "compact_post.hpp"
+#include "app_msg.hpp"
+
+#include <charconv>
+#include <cstring>
+#include <iterator>
+#include <string_view>
+#include <algorithm>
+
+namespace occase
+{
+
+namespace
+{
+
+// The number of image hosts a channel keeps. Images of other hosts
+// are stored verbatim.
+auto constexpr max_hosts = 64;
+
+auto constexpr max_id_size = 12;
+auto constexpr image_ext = std::string_view {".jpeg"};
+
+// Returns the position of c in the pwd_gen character set or -1.
+int pwd_index(char c) noexcept
+{
+   if (c >= 'a' && c <= 'z')
+      return c - 'a';
+
+   if (c >= '0' && c <= '9')
+      return 26 + c - '0';
+
+   return -1;
+}
+
+char pwd_char(int i) noexcept
+{
+   return i < 26 ? 'a' + i : '0' + i - 26;
+}
+
+// The id is stored as a number in base 37, the first character in
+// the least significant digit. Zero marks the end.
+bool pack_id(std::string const& id, std::uint64_t& code)
+{
+   if (std::ssize(id) > max_id_size)
+      return false;
+
+   code = 0;
+   for (auto i = std::ssize(id) - 1; i >= 0; --i) {
+      auto const d = pwd_index(id[i]);
+      if (d < 0)
+         return false;
+
+      code = 37 * code + d + 1;
+   }
+
+   return true;
+}
+
+std::string unpack_id(std::uint64_t code)
+{
+   std::string ret;
+   for (; code != 0; code /= 37)
+      ret.push_back(pwd_char(code % 37 - 1));
+
+   return ret;
+}
+
+// Appends the part of the image path that follows the host.
+void append_image_path(std::string& out, std::string_view filename)
+{
+   out += "/posts/imgs";
+   out += make_dir(std::string {filename});
+   out += "/";
+   out += filename;
+   out += image_ext;
+}
+
+std::string image_path(std::string_view filename)
+{
+   std::string ret;
+   append_image_path(ret, filename);
+   return ret;
+}
+
+// Returns the filename of an image generated by get_upload_credit or
+// an empty view if the url does not have that form.
+std::string_view image_filename(std::string const& url)
+{
+   auto constexpr n = sz::mms_filename_size;
+   if (std::size(url) < n + std::size(image_ext))
+      return {};
+
+   std::string_view const v = url;
+   if (!v.ends_with(image_ext))
+      return {};
+
+   auto const filename = v.substr(std::size(v) - std::size(image_ext) - n, n);
+
+   auto f = [](auto c)
+      { return pwd_index(c) >= 0; };
+
+   if (!std::all_of(std::cbegin(filename), std::cend(filename), f))
+      return {};
+
+   if (!v.ends_with(image_path(filename)))
+      return {};
+
+   return filename;
+}
+
+struct writer {
+   std::string buffer;
+
+   void varint(std::uint64_t v)
+   {
+      while (v >= 0x80) {
+         buffer.push_back(char(v | 0x80));
+         v >>= 7;
+      }
+
+      buffer.push_back(char(v));
+   }
+
+   // Zigzag encoding so that small negative values are short too.
+   void integer(int v)
+   {
+      varint((std::uint32_t(v) << 1) ^ std::uint32_t(v >> 31));
+   }
+
+   void string(std::string_view s)
+   {
+      varint(std::size(s));
+      buffer.append(s);
+   }
+
+   void integers(std::vector<int> const& v)
+   {
+      varint(std::size(v));
+      for (auto e : v)
+         integer(e);
+   }
+};
+
+struct reader {
+   char const* p;
+
+   std::uint64_t varint() noexcept
+   {
+      std::uint64_t ret = 0;
+      for (auto shift = 0;; shift += 7) {
+         auto const b = std::uint8_t(*p++);
+         ret |= std::uint64_t(b & 0x7f) << shift;
+         if (b < 0x80)
+            return ret;
+      }
+   }
+
+   int integer() noexcept
+   {
+      auto const v = std::uint32_t(varint());
+      return int(v >> 1) ^ -int(v & 1);
+   }
+
+   std::string string()
+   {
+      auto const n = varint();
+      std::string ret(p, n);
+      p += n;
+      return ret;
+   }
+
+   std::vector<int> integers()
+   {
+      std::vector<int> ret(varint());
+      for (auto& e : ret)
+         e = integer();
+
+      return ret;
+   }
+
+   // Skip the fields, returning where they start.
+   char const* skip_string() noexcept
+   {
+      auto const ret = p;
+      auto const n = varint();
+      p += n;
+      return ret;
+   }
+
+   char const* skip_integers() noexcept
+   {
+      auto const ret = p;
+      for (auto n = varint(); n != 0; --n)
+         varint();
+
+      return ret;
+   }
+};
+
+template <class T>
+void append_number(std::string& out, T v)
+{
+   char buffer[24];
+   auto const res = std::to_chars(buffer, buffer + sizeof buffer, v);
+   out.append(buffer, res.ptr);
+}
+
+void append_integers(std::string& out, char const* p)
+{
+   reader r {p};
+   out.push_back('[');
+   for (auto n = r.varint(); n != 0; --n) {
+      append_number(out, r.integer());
+      out.push_back(',');
+   }
+
+   if (out.back() == ',')
+      out.back() = ']';
+   else
+      out.push_back(']');
+}
+
+} // anonymous
+
+compact_post::compact_post(
+   post const& p,
+   image_hosts& hosts,
+   intern_table& strings)
+: date_ {p.date.count()}
+, from_ {strings.intern(p.from)}
+, nick_ {strings.intern(p.nick)}
+, avatar_ {strings.intern(p.avatar)}
+, visualizations_ {p.visualizations}
+{
+   has_id_ = pack_id(p.id, id_);
+
+   writer w;
+   w.integers(p.location);
+   w.integers(p.product);
+
+   if (!has_id_)
+      w.string(p.id);
+
+   w.string(p.description);
+   w.integers(p.ex_details);
+
+   w.varint(std::size(p.in_details));
+   for (auto e : p.in_details)
+      w.varint(e);
+
+   w.integers(p.range_values);
+
+   // Each image starts with zero when stored verbatim or with the
+   // host index plus one followed by the filename.
+   w.varint(std::size(p.images));
+   for (auto const& url : p.images) {
+      auto const filename = image_filename(url);
+      if (std::empty(filename)) {
+         w.varint(0);
+         w.string(url);
+         continue;
+      }
+
+      std::string_view const host {url.data(), std::size(url) - std::size(image_path(filename))};
+
+      auto match = std::find(std::cbegin(hosts), std::cend(hosts), host);
+      if (match == std::cend(hosts)) {
+         if (std::ssize(hosts) == max_hosts) {
+            w.varint(0);
+            w.string(url);
+            continue;
+         }
+
+         hosts.push_back(std::string {host});
+         match = std::prev(std::cend(hosts));
+      }
+
+      w.varint(std::distance(std::cbegin(hosts), match) + 1);
+      w.buffer.append(filename);
+   }
+
+   size_ = std::size(w.buffer);
+   data_ = std::make_unique<char[]>(size_);
+   std::memcpy(data_.get(), w.buffer.data(), size_);
+}
+
+compact_post::compact_post(compact_post const& other)
+: date_ {other.date_}
+, id_ {other.id_}
+, data_ {other.data_ ? std::make_unique<char[]>(other.size_) : nullptr}
+, from_ {other.from_}
+, nick_ {other.nick_}
+, avatar_ {other.avatar_}
+, visualizations_ {other.visualizations_}
+, size_ {other.size_}
+, has_id_ {other.has_id_}
+{
+   if (data_)
+      std::memcpy(data_.get(), other.data_.get(), size_);
+}
+
+compact_post& compact_post::operator=(compact_post const& other)
+{
+   if (this != &other)
+      *this = compact_post {other};
+
+   return *this;
+}
+
+post compact_post::decode(image_hosts const& hosts) const
+{
+   post ret;
+   if (!data_)
+      return ret;
+
+   reader r {data_.get()};
+
+   ret.date = date();
+   ret.visualizations = visualizations_;
+   ret.location = r.integers();
+   ret.product = r.integers();
+   ret.id = has_id_ ? unpack_id(id_) : r.string();
+   ret.from = from_.str();
+   ret.nick = nick_.str();
+   ret.avatar = avatar_.str();
+   ret.description = r.string();
+   ret.ex_details = r.integers();
+
+   ret.in_details.resize(r.varint());
+   for (auto& e : ret.in_details)
+      e = r.varint();
+
+   ret.range_values = r.integers();
+
+   ret.images.resize(r.varint());
+   for (auto& url : ret.images) {
+      auto const host = r.varint();
+      if (host == 0) {
+         url = r.string();
+         continue;
+      }
+
+      std::string_view const filename {r.p, sz::mms_filename_size};
+      r.p += sz::mms_filename_size;
+
+      url = hosts[host - 1];
+      url += image_path(filename);
+   }
+
+   return ret;
+}
+
+void compact_post::write_json(image_hosts const& hosts, std::string& out) const
+{
+   if (!data_) {
+      out += json(post{}).dump();
+      return;
+   }
+
+   // The buffer stores the fields in a different order than the
+   // sorted keys of json::dump, their positions are found first.
+   reader r {data_.get()};
+   auto const location = r.skip_integers();
+   auto const product = r.skip_integers();
+   auto const id = has_id_ ? nullptr : r.skip_string();
+   auto const description = r.skip_string();
+   auto const ex_details = r.skip_integers();
+   auto const in_details = r.skip_integers();
+   auto const range_values = r.skip_integers();
+   auto const images = r.p;
+
+   auto string = [&](char const* p)
+   {
+      reader s {p};
+      auto const n = s.varint();
+      append_json_string(out, {s.p, n});
+   };
+
+   out += "{\"avatar\":";
+   append_json_string(out, avatar_.str());
+   out += ",\"date\":";
+   append_number(out, date_);
+   out += ",\"description\":";
+   string(description);
+   out += ",\"ex_details\":";
+   append_integers(out, ex_details);
+   out += ",\"from\":";
+   append_json_string(out, from_.str());
+   out += ",\"id\":";
+   if (has_id_)
+      append_json_string(out, unpack_id(id_));
+   else
+      string(id);
+
+   out += ",\"images\":";
+   r.p = images;
+   out.push_back('[');
+   std::string url;
+   for (auto n = r.varint(); n != 0; --n) {
+      auto const host = r.varint();
+      if (host == 0) {
+         string(r.skip_string());
+      } else {
+         std::string_view const filename {r.p, sz::mms_filename_size};
+         r.p += sz::mms_filename_size;
+         url = hosts[host - 1];
+         append_image_path(url, filename);
+         append_json_string(out, url);
+      }
+
+      out.push_back(',');
+   }
+
+   if (out.back() == ',')
+      out.back() = ']';
+   else
+      out.push_back(']');
+
+   // Unsigned, not zigzag encoded.
+   out += ",\"in_details\":";
+   r.p = in_details;
+   out.push_back('[');
+   for (auto n = r.varint(); n != 0; --n) {
+      append_number(out, r.varint());
+      out.push_back(',');
+   }
+
+   if (out.back() == ',')
+      out.back() = ']';
+   else
+      out.push_back(']');
+
+   out += ",\"location\":";
+   append_integers(out, location);
+   out += ",\"nick\":";
+   append_json_string(out, nick_.str());
+   out += ",\"product\":";
+   append_integers(out, product);
+   out += ",\"range_values\":";
+   append_integers(out, range_values);
+   out += ",\"visualizations\":";
+   append_number(out, visualizations_);
+   out.push_back('}');
+}
+
+std::string compact_post::id() const
+{
+   if (has_id_)
+      return unpack_id(id_);
+
+   if (!data_)
+      return {};
+
+   reader r {data_.get()};
+   r.integers();
+   r.integers();
+   return r.string();
+}
+
+std::vector<int> compact_post::location() const
+{
+   if (!data_)
+      return {};
+
+   reader r {data_.get()};
+   return r.integers();
+}
+
+std::vector<int> compact_post::product() const
+{
+   if (!data_)
+      return {};
+
+   reader r {data_.get()};
+   r.integers();
+   return r.integers();
+}
+
+} // occase
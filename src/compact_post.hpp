@@ -0,0 +1,82 @@
+#pragma once
+
+#include <memory>
+#include <string>
+#include <vector>
+#include <cstdint>
+
+#include "post.hpp"
+#include "intern.hpp"
+
+namespace occase {
+
+// The hosts of the image urls of the posts in a channel. Images are
+// stored as an index in this table plus their filename.
+using image_hosts = std::vector<std::string>;
+
+// A post encoded to take less memory, used by the channel to store
+// its posts. Compared to post
+//
+//   * Ids of up to 12 characters of the pwd_gen character set are
+//     stored as integers.
+//   * from, nick and avatar are interned, so that the posts of the
+//     same author share them.
+//   * Images of the form generated by worker::get_upload_credit
+//
+//        host/posts/imgs/a/b/cd/abcdefgh.jpeg
+//
+//     are stored as the index of the host and the filename and are
+//     rebuilt on decode.
+//   * All other fields are stored one after the other in a single
+//     buffer, prefixed with their size as varints, so that small
+//     strings cost only their characters and no allocation.
+//
+// Fields that don't have the expected form are stored verbatim in
+// the buffer.
+class compact_post {
+private:
+   date_type::rep date_ = 0;
+   std::uint64_t id_ = 0;
+   std::unique_ptr<char[]> data_;
+   interned_string from_;
+   interned_string nick_;
+   interned_string avatar_;
+   int visualizations_ = 0;
+   std::uint32_t size_ = 0;
+
+   // Tells whether id_ is used.
+   bool has_id_ = false;
+
+public:
+   compact_post() = default;
+
+   // Encodes the post. Image hosts not in hosts are added to it and
+   // the strings shared among posts are interned in strings.
+   compact_post(post const& p, image_hosts& hosts, intern_table& strings);
+
+   compact_post(compact_post const& other);
+   compact_post& operator=(compact_post const& other);
+   compact_post(compact_post&&) = default;
+   compact_post& operator=(compact_post&&) = default;
+
+   post decode(image_hosts const& hosts) const;
+
+   // Appends the post to out with the same bytes as
+   // json(decode(hosts)).dump(), without decoding it.
+   void write_json(image_hosts const& hosts, std::string& out) const;
+
+   std::string id() const;
+   std::string const& from() const noexcept { return from_.str(); }
+   auto date() const noexcept { return date_type {date_}; }
+   auto visualizations() const noexcept { return visualizations_; }
+   void set_visualizations(int n) noexcept { visualizations_ = n; }
+
+   // Decode only the location and product, that are stored first.
+   std::vector<int> location() const;
+   std::vector<int> product() const;
+
+   // The number of bytes allocated by the post.
+   auto allocated() const noexcept { return size_; }
+};
+
+} // occase
@@ -17,6 +17,9 @@ struct timeouts {
    // Time after which the post is considered expired. Input in
    // seconds.
    std::chrono::seconds post_expiration;
+
+   // The interval between two checks for expired posts.
+   std::chrono::seconds post_expiration_interval;
 };
 
 struct redis {
@@ -71,6 +74,18 @@ struct redis {
    // The redis key holding the number of visualizations of each post.
    std::string post_visualizations_key {"post_visualizations"};
 
+   // The redis stream where publications and deletions of posts are
+   // logged. Nodes use it to catch up after a reconnection.
+   std::string posts_log_key {"posts_log"};
+
+   // The approximate maximum number of entries in the posts log.
+   int posts_log_size {100000};
+
+   // Whether messages on the posts channel and in the posts log are
+   // sent in the binary envelope of node_msg instead of json. Both
+   // are always accepted.
+   bool posts_channel_binary {false};
+
    // Expiration time for user message keys. Keys will be deleted on
    // expiration and all chat messages that have not been retrieved
    // are gone.
@@ -126,6 +141,20 @@ struct core {
    // reached. This value is also configurable via adm api.
    int allowed_posts = 0;
 
+   // The maximum number of expired posts removed at once.
+   int post_expiration_batch = 1000;
+
+   // The file where the channel snapshot is stored. Snapshots are
+   // disabled when empty.
+   std::string snapshot_file;
+
+   // The interval in seconds between two snapshots.
+   int snapshot_interval = 300;
+
+   // The maximum number of /posts/search and /posts/count responses
+   // kept in the cache of each worker. Zero disables the cache.
+   int search_cache_size = 1000;
+
    // See config/occase-db.conf for a description.
    std::string chat_admin_id;
 
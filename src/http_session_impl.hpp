@@ -70,6 +70,12 @@ beast::string_view prepare_target(beast::string_view t, char s)
    return t;
 }
 
+enum class search_type
+{ posts
+, count
+, facets
+};
+
 template <class Derived>
 class http_session_impl {
 protected:
@@ -134,24 +140,42 @@ private:
       }
    }
 
-   void post_search_handler(bool only_count = false) noexcept
+   void post_search_handler(search_type type) noexcept
    {
       try {
 	 post p;
+	 std::string cursor;
+	 auto by = channel::order_by::none;
 	 if (!std::empty(req_.body())) {
 	    auto const j = json::parse(req_.body());
 	    p = j.at("post").get<post>();
+	    cursor = get_optional_field<std::string>(j, "cursor");
+	    by = to_order_by(get_optional_field<std::string>(j, "order_by"));
 	 }
 
          resp_.set(http::field::content_type, "application/json");
 
-	 if (only_count) {
-	    auto const n = w_.count_posts(p);
-	    resp_.body() = std::to_string(n) + "\r\n";
-	 } else {
-	    json j;
-	    j["posts"] = w_.search_posts(p);
-	    resp_.body() = j.dump() + "\r\n";
+	 switch (type) {
+	    case search_type::count:
+	    {
+	       resp_.body().clear();
+	       w_.count_posts(p, resp_.body());
+	       resp_.body() += "\r\n";
+	    } break;
+	    case search_type::facets:
+	    {
+	       auto const f = w_.facet_posts(p);
+	       json j;
+	       j["location"] = f.location;
+	       j["product"] = f.product;
+	       resp_.body() = j.dump() + "\r\n";
+	    } break;
+	    default:
+	    {
+	       resp_.body().clear();
+	       w_.search_posts(p, cursor, by, resp_.body());
+	       resp_.body() += "\r\n";
+	    }
 	 }
 
       } catch (std::exception const& e) {
@@ -208,9 +232,14 @@ private:
    void post_publish_handler() noexcept
    {
       try {
-         auto const body = w_.on_publish_impl(json::parse(req_.body()));
+	 app_msg m;
+	 if (!m.parse(req_.body()))
+	    throw std::runtime_error("Invalid body.");
+
+	 resp_.body().clear();
+         w_.on_publish_impl(m, resp_.body());
          resp_.set(http::field::content_type, "application/json");
-	 resp_.body() = body + "\r\n";
+	 resp_.body() += "\r\n";
       } catch (std::exception const& e) {
          set_not_fount_header();
          log::write( log::level::err
@@ -222,9 +251,10 @@ private:
    void get_user_id_handler() noexcept
    {
       try {
-         auto const body = w_.on_get_user_id();
+	 resp_.body().clear();
+         w_.on_get_user_id(resp_.body());
          resp_.set(http::field::content_type, "application/json");
-	 resp_.body() = body + "\r\n";
+	 resp_.body() += "\r\n";
       } catch (std::exception const& e) {
          set_not_fount_header();
          log::write( log::level::err
@@ -274,6 +304,7 @@ private:
          std::string const target {t.data(), std::size(t)};
 
          char const count[]  = "/posts/count";
+         char const facets[] = "/posts/facets";
          char const search[] = "/posts/search";
          char const upload[] = "/posts/upload-credit";
          char const del[]    = "/posts/delete";
@@ -282,11 +313,13 @@ private:
 	 char const get_user_id[] = "/get-user-id";
 
          if (t.compare(0, sizeof count, count) == 0) {
-            post_search_handler(true);
+            post_search_handler(search_type::count);
+	 } else if (t.compare(0, sizeof facets, facets) == 0) {
+            post_search_handler(search_type::facets);
 	 } else if (t.compare(0, sizeof visua, visua) == 0) {
             post_visualization_handler();
 	 } else if (t.compare(0, sizeof search, search) == 0) {
-            post_search_handler();
+            post_search_handler(search_type::posts);
 	 } else if (t.compare(0, sizeof upload, upload) == 0) {
             post_upload_credit_handler();
 	 } else if (t.compare(0, sizeof del, del) == 0) {
@@ -0,0 +1,61 @@
+#include "intern.hpp"
+
+#include <memory>
+
+namespace occase
+{
+
+interned_string::interned_string(entry* e) noexcept
+: e_ {e}
+{
+   if (e_)
+      ++e_->refs;
+}
+
+interned_string::interned_string(interned_string const& other) noexcept
+: interned_string {other.e_}
+{ }
+
+interned_string::~interned_string()
+{
+   if (!e_ || --e_->refs != 0)
+      return;
+
+   if (e_->table)
+      e_->table->erase(e_);
+
+   delete e_;
+}
+
+std::string const& interned_string::str() const noexcept
+{
+   static std::string const empty;
+   return e_ ? e_->value : empty;
+}
+
+intern_table::~intern_table()
+{
+   for (auto const& e : entries_)
+      e.second->table = nullptr;
+}
+
+void intern_table::erase(interned_string::entry* e)
+{
+   entries_.erase(e->value);
+}
+
+interned_string intern_table::intern(std::string_view s)
+{
+   if (std::empty(s))
+      return {};
+
+   auto const match = entries_.find(s);
+   if (match != std::end(entries_))
+      return interned_string {match->second};
+
+   auto e = std::make_unique<interned_string::entry>(std::string {s}, 0, this);
+   entries_.insert({e->value, e.get()});
+   return interned_string {e.release()};
+}
+
+} // occase
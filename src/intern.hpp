@@ -0,0 +1,99 @@
+#pragma once
+
+#include <string>
+#include <utility>
+#include <functional>
+#include <string_view>
+#include <unordered_map>
+
+namespace occase {
+
+class intern_table;
+
+// A handle to a string of an intern_table. Copies share the string,
+// which is removed from the table with the last handle. The default
+// handle holds the empty string.
+//
+// Not thread safe: the handles of a table must be used on a single
+// thread.
+class interned_string {
+private:
+   friend class intern_table;
+
+   struct entry {
+      std::string value;
+      std::size_t refs = 0;
+
+      // Null when the table is destroyed before its handles.
+      intern_table* table = nullptr;
+   };
+
+   entry* e_ = nullptr;
+
+   explicit interned_string(entry* e) noexcept;
+
+public:
+   interned_string() = default;
+   interned_string(interned_string const& other) noexcept;
+   interned_string(interned_string&& other) noexcept
+      : e_ {std::exchange(other.e_, nullptr)} {}
+
+   interned_string& operator=(interned_string other) noexcept
+      { std::swap(e_, other.e_); return *this; }
+
+   ~interned_string();
+
+   std::string const& str() const noexcept;
+   auto empty() const noexcept { return e_ == nullptr; }
+
+   friend bool
+   operator==(interned_string const& a, interned_string const& b) noexcept
+      { return a.e_ == b.e_ || a.str() == b.str(); }
+
+   friend bool
+   operator==(interned_string const& a, std::string_view b) noexcept
+      { return a.str() == b; }
+};
+
+// Hashes interned strings like the string they hold so that
+// unordered containers keyed by interned strings can be searched
+// with plain strings. Use with std::equal_to<>.
+struct interned_hash {
+   using is_transparent = void;
+
+   std::size_t operator()(std::string_view s) const noexcept
+      { return std::hash<std::string_view>{}(s); }
+
+   std::size_t operator()(interned_string const& s) const noexcept
+      { return (*this)(s.str()); }
+};
+
+// Stores one copy of each string that is in use, e.g. the author of
+// posts and the user id of sessions, where the same value is repeated
+// many times.
+class intern_table {
+private:
+   friend class interned_string;
+
+   // The keys point to the value of the entries.
+   std::unordered_map<std::string_view, interned_string::entry*> entries_;
+
+   void erase(interned_string::entry* e);
+
+public:
+   intern_table() = default;
+   intern_table(intern_table const&) = delete;
+   intern_table& operator=(intern_table const&) = delete;
+
+   // Handles that outlive the table keep their strings.
+   ~intern_table();
+
+   // Returns the handle of the string, adding it to the table if it
+   // is not there yet.
+   interned_string intern(std::string_view s);
+
+   // The number of distinct strings.
+   auto size() const noexcept { return std::size(entries_); }
+};
+
+} // occase
@@ -0,0 +1,241 @@
+#include "kernels.hpp"
+
+#if defined(__x86_64__)
+#include <immintrin.h>
+#endif
+
+namespace occase
+{
+
+bool has_avx2() noexcept
+{
+#if defined(__x86_64__)
+   static bool const r = __builtin_cpu_supports("avx2");
+   return r;
+#else
+   return false;
+#endif
+}
+
+bool has_avx512() noexcept
+{
+#if defined(__x86_64__)
+   static bool const r = __builtin_cpu_supports("avx512f");
+   return r;
+#else
+   return false;
+#endif
+}
+
+void
+any_of_scalar(
+   std::uint64_t const* column,
+   slot_type const* begin,
+   slot_type const* end,
+   std::uint64_t mask,
+   std::vector<slot_type>& out)
+{
+   for (; begin != end; ++begin) {
+      if (column[*begin] & mask)
+         out.push_back(*begin);
+   }
+}
+
+#if defined(__x86_64__)
+
+__attribute__((target("avx2")))
+void
+any_of_avx2(
+   std::uint64_t const* column,
+   slot_type const* begin,
+   slot_type const* end,
+   std::uint64_t mask,
+   std::vector<slot_type>& out)
+{
+   auto const m = _mm256_set1_epi64x(mask);
+   auto const zero = _mm256_setzero_si256();
+   auto const* base = reinterpret_cast<long long const*>(column);
+
+   // Four slots per iteration: gathers their masks, compares with
+   // zero and keeps the slots whose lane is not zero.
+   for (; end - begin >= 4; begin += 4) {
+      auto const idx =
+         _mm_loadu_si128(reinterpret_cast<__m128i const*>(begin));
+
+      auto const v = _mm256_i32gather_epi64(base, idx, 8);
+      auto const eq = _mm256_cmpeq_epi64(_mm256_and_si256(v, m), zero);
+      auto bits = ~_mm256_movemask_pd(_mm256_castsi256_pd(eq)) & 0xf;
+
+      while (bits != 0) {
+         out.push_back(begin[__builtin_ctz(bits)]);
+         bits &= bits - 1;
+      }
+   }
+
+   any_of_scalar(column, begin, end, mask, out);
+}
+
+#else
+
+void
+any_of_avx2(
+   std::uint64_t const* column,
+   slot_type const* begin,
+   slot_type const* end,
+   std::uint64_t mask,
+   std::vector<slot_type>& out)
+{
+   any_of_scalar(column, begin, end, mask, out);
+}
+
+#endif
+
+void
+any_of(
+   std::uint64_t const* column,
+   slot_type const* begin,
+   slot_type const* end,
+   std::uint64_t mask,
+   std::vector<slot_type>& out)
+{
+   if (has_avx2())
+      any_of_avx2(column, begin, end, mask, out);
+   else
+      any_of_scalar(column, begin, end, mask, out);
+}
+
+void
+prefix_of_scalar(
+   packed_code const* column,
+   slot_type const* begin,
+   slot_type const* end,
+   packed_code value,
+   packed_code mask,
+   std::vector<slot_type>& out)
+{
+   for (; begin != end; ++begin) {
+      auto const code = column[*begin];
+      if (((code ^ value) & mask) == 0 || code == packed_unfit)
+         out.push_back(*begin);
+   }
+}
+
+#if defined(__x86_64__)
+
+__attribute__((target("avx2")))
+void
+prefix_of_avx2(
+   packed_code const* column,
+   slot_type const* begin,
+   slot_type const* end,
+   packed_code value,
+   packed_code mask,
+   std::vector<slot_type>& out)
+{
+   auto const v = _mm256_set1_epi64x(value);
+   auto const m = _mm256_set1_epi64x(mask);
+   auto const unfit = _mm256_set1_epi64x(packed_unfit);
+   auto const zero = _mm256_setzero_si256();
+   auto const* base = reinterpret_cast<long long const*>(column);
+
+   for (; end - begin >= 4; begin += 4) {
+      auto const idx =
+         _mm_loadu_si128(reinterpret_cast<__m128i const*>(begin));
+
+      auto const c = _mm256_i32gather_epi64(base, idx, 8);
+      auto const diff = _mm256_and_si256(_mm256_xor_si256(c, v), m);
+      auto const keep = _mm256_or_si256(
+         _mm256_cmpeq_epi64(diff, zero),
+         _mm256_cmpeq_epi64(c, unfit));
+
+      auto bits = _mm256_movemask_pd(_mm256_castsi256_pd(keep));
+      while (bits != 0) {
+         out.push_back(begin[__builtin_ctz(bits)]);
+         bits &= bits - 1;
+      }
+   }
+
+   prefix_of_scalar(column, begin, end, value, mask, out);
+}
+
+__attribute__((target("avx512f")))
+void
+prefix_of_avx512(
+   packed_code const* column,
+   slot_type const* begin,
+   slot_type const* end,
+   packed_code value,
+   packed_code mask,
+   std::vector<slot_type>& out)
+{
+   auto const v = _mm512_set1_epi64(value);
+   auto const m = _mm512_set1_epi64(mask);
+   auto const unfit = _mm512_set1_epi64(packed_unfit);
+
+   // Eight slots per iteration. The mask registers give the lanes
+   // directly.
+   for (; end - begin >= 8; begin += 8) {
+      auto const idx =
+         _mm256_loadu_si256(reinterpret_cast<__m256i const*>(begin));
+
+      auto const c = _mm512_mask_i32gather_epi64(
+         _mm512_setzero_si512(), 0xff, idx, column, 8);
+      unsigned bits =
+         _mm512_testn_epi64_mask(_mm512_xor_si512(c, v), m)
+         | _mm512_cmpeq_epi64_mask(c, unfit);
+
+      while (bits != 0) {
+         out.push_back(begin[__builtin_ctz(bits)]);
+         bits &= bits - 1;
+      }
+   }
+
+   prefix_of_scalar(column, begin, end, value, mask, out);
+}
+
+#else
+
+void
+prefix_of_avx2(
+   packed_code const* column,
+   slot_type const* begin,
+   slot_type const* end,
+   packed_code value,
+   packed_code mask,
+   std::vector<slot_type>& out)
+{
+   prefix_of_scalar(column, begin, end, value, mask, out);
+}
+
+void
+prefix_of_avx512(
+   packed_code const* column,
+   slot_type const* begin,
+   slot_type const* end,
+   packed_code value,
+   packed_code mask,
+   std::vector<slot_type>& out)
+{
+   prefix_of_scalar(column, begin, end, value, mask, out);
+}
+
+#endif
+
+void
+prefix_of(
+   packed_code const* column,
+   slot_type const* begin,
+   slot_type const* end,
+   packed_code value,
+   packed_code mask,
+   std::vector<slot_type>& out)
+{
+   if (has_avx512())
+      prefix_of_avx512(column, begin, end, value, mask, out);
+   else if (has_avx2())
+      prefix_of_avx2(column, begin, end, value, mask, out);
+   else
+      prefix_of_scalar(column, begin, end, value, mask, out);
+}
+
+} // occase
@@ -0,0 +1,91 @@
+#pragma once
+
+#include <vector>
+#include <cstdint>
+
+#include "code_index.hpp"
+
+namespace occase {
+
+// Kernels used by the channel to filter candidate posts. Each kernel
+// has a scalar version and, where available, a SIMD version that is
+// selected at runtime according to the cpu features.
+
+// Appends to out the slots s in [begin, end) for which
+//
+//    (column[s] & mask) != 0
+//
+void
+any_of(
+   std::uint64_t const* column,
+   slot_type const* begin,
+   slot_type const* end,
+   std::uint64_t mask,
+   std::vector<slot_type>& out);
+
+void
+any_of_scalar(
+   std::uint64_t const* column,
+   slot_type const* begin,
+   slot_type const* end,
+   std::uint64_t mask,
+   std::vector<slot_type>& out);
+
+void
+any_of_avx2(
+   std::uint64_t const* column,
+   slot_type const* begin,
+   slot_type const* end,
+   std::uint64_t mask,
+   std::vector<slot_type>& out);
+
+// Appends to out the slots s in [begin, end) for which
+//
+//    ((column[s] ^ value) & mask) == 0 || column[s] == packed_unfit
+//
+// that is, the packed codes that are children of the packed prefix
+// value, see prefix_mask, and the codes that have to be compared
+// unpacked.
+void
+prefix_of(
+   packed_code const* column,
+   slot_type const* begin,
+   slot_type const* end,
+   packed_code value,
+   packed_code mask,
+   std::vector<slot_type>& out);
+
+void
+prefix_of_scalar(
+   packed_code const* column,
+   slot_type const* begin,
+   slot_type const* end,
+   packed_code value,
+   packed_code mask,
+   std::vector<slot_type>& out);
+
+void
+prefix_of_avx2(
+   packed_code const* column,
+   slot_type const* begin,
+   slot_type const* end,
+   packed_code value,
+   packed_code mask,
+   std::vector<slot_type>& out);
+
+void
+prefix_of_avx512(
+   packed_code const* column,
+   slot_type const* begin,
+   slot_type const* end,
+   packed_code value,
+   packed_code mask,
+   std::vector<slot_type>& out);
+
+// Returns true if the cpu supports avx2.
+bool has_avx2() noexcept;
+
+// Returns true if the cpu supports avx512f.
+bool has_avx512() noexcept;
+
+} // occase
@@ -0,0 +1,266 @@
+#include "node_msg.hpp"
+
+#include <stdexcept>
+
+namespace occase
+{
+
+namespace
+{
+
+auto constexpr envelope_tag = '\0';
+auto constexpr envelope_version = 1;
+
+struct writer {
+   std::string buffer;
+
+   void varint(std::uint64_t v)
+   {
+      while (v >= 0x80) {
+         buffer.push_back(char(v | 0x80));
+         v >>= 7;
+      }
+
+      buffer.push_back(char(v));
+   }
+
+   void integer(std::int64_t v)
+   {
+      varint((std::uint64_t(v) << 1) ^ std::uint64_t(v >> 63));
+   }
+
+   void string(std::string_view s)
+   {
+      varint(std::size(s));
+      buffer.append(s);
+   }
+
+   void integers(std::vector<int> const& v)
+   {
+      varint(std::size(v));
+      for (auto e : v)
+         integer(e);
+   }
+};
+
+// Unlike the reader of compact_post the input is not trusted.
+struct reader {
+   char const* p;
+   char const* end;
+
+   std::uint64_t varint()
+   {
+      std::uint64_t ret = 0;
+      for (auto shift = 0; shift < 64; shift += 7) {
+         if (p == end)
+            break;
+
+         auto const b = std::uint8_t(*p++);
+         ret |= std::uint64_t(b & 0x7f) << shift;
+         if (b < 0x80)
+            return ret;
+      }
+
+      throw std::runtime_error("parse_node_msg: invalid varint.");
+   }
+
+   std::int64_t integer()
+   {
+      auto const v = varint();
+      return std::int64_t(v >> 1) ^ -std::int64_t(v & 1);
+   }
+
+   // Returns the size of a string or vector, which is at least one
+   // byte per element.
+   std::size_t size()
+   {
+      auto const n = varint();
+      if (n > std::uint64_t(end - p))
+         throw std::runtime_error("parse_node_msg: truncated message.");
+
+      return n;
+   }
+
+   std::string string()
+   {
+      auto const n = size();
+      std::string ret(p, n);
+      p += n;
+      return ret;
+   }
+
+   std::vector<int> integers()
+   {
+      std::vector<int> ret(size());
+      for (auto& e : ret)
+         e = integer();
+
+      return ret;
+   }
+};
+
+void write_post(writer& w, post const& p)
+{
+   w.integer(p.date.count());
+   w.integer(p.visualizations);
+   w.string(p.id);
+   w.string(p.from);
+   w.string(p.nick);
+   w.string(p.avatar);
+   w.string(p.description);
+   w.integers(p.location);
+   w.integers(p.product);
+   w.integers(p.ex_details);
+
+   w.varint(std::size(p.in_details));
+   for (auto e : p.in_details)
+      w.varint(e);
+
+   w.integers(p.range_values);
+
+   w.varint(std::size(p.images));
+   for (auto const& e : p.images)
+      w.string(e);
+}
+
+post read_post(reader& r)
+{
+   post ret;
+   ret.date = date_type {r.integer()};
+   ret.visualizations = r.integer();
+   ret.id = r.string();
+   ret.from = r.string();
+   ret.nick = r.string();
+   ret.avatar = r.string();
+   ret.description = r.string();
+   ret.location = r.integers();
+   ret.product = r.integers();
+   ret.ex_details = r.integers();
+
+   ret.in_details.resize(r.size());
+   for (auto& e : ret.in_details)
+      e = r.varint();
+
+   ret.range_values = r.integers();
+
+   ret.images.resize(r.size());
+   for (auto& e : ret.images)
+      e = r.string();
+
+   return ret;
+}
+
+std::string to_json_text(node_msg const& m)
+{
+   json j;
+   switch (m.cmd) {
+      case node_msg::kind::publish:
+      {
+         j["cmd"] = "publish_internal";
+         j["post"] = m.item;
+      } break;
+      case node_msg::kind::remove:
+      {
+         j["cmd"] = "delete";
+         j["from"] = m.from;
+         j["post_id"] = m.post_id;
+      } break;
+      case node_msg::kind::visualization:
+      {
+         j["cmd"] = "visualization";
+         j["post_id"] = m.post_id;
+      } break;
+      default:
+         throw std::runtime_error("serialize: unknown message.");
+   }
+
+   return j.dump();
+}
+
+node_msg from_json_text(std::string_view msg)
+{
+   auto const j = json::parse(msg);
+   auto const cmd = j.at("cmd").get<std::string>();
+
+   node_msg ret;
+   if (cmd == "publish_internal") {
+      ret.cmd = node_msg::kind::publish;
+      ret.item = j.at("post").get<post>();
+   } else if (cmd == "delete") {
+      ret.cmd = node_msg::kind::remove;
+      ret.from = j.at("from").get<std::string>();
+      ret.post_id = j.at("post_id").get<std::string>();
+   } else if (cmd == "visualization") {
+      ret.cmd = node_msg::kind::visualization;
+      ret.post_id = j.at("post_id").get<std::string>();
+   }
+
+   return ret;
+}
+
+} // anonymous
+
+std::string serialize(node_msg const& m, bool binary)
+{
+   if (!binary)
+      return to_json_text(m);
+
+   writer w;
+   w.buffer.push_back(envelope_tag);
+   w.buffer.push_back(char(envelope_version));
+   w.buffer.push_back(char(m.cmd));
+
+   switch (m.cmd) {
+      case node_msg::kind::publish:
+         write_post(w, m.item);
+         break;
+      case node_msg::kind::remove:
+      {
+         w.string(m.from);
+         w.string(m.post_id);
+      } break;
+      case node_msg::kind::visualization:
+         w.string(m.post_id);
+         break;
+      default:
+         throw std::runtime_error("serialize: unknown message.");
+   }
+
+   return std::move(w.buffer);
+}
+
+node_msg parse_node_msg(std::string_view msg)
+{
+   if (std::empty(msg) || msg.front() != envelope_tag)
+      return from_json_text(msg);
+
+   if (std::size(msg) < 3 || msg[1] != char(envelope_version))
+      throw std::runtime_error("parse_node_msg: unsupported envelope.");
+
+   reader r {msg.data() + 3, msg.data() + std::size(msg)};
+
+   node_msg ret;
+   ret.cmd = static_cast<node_msg::kind>(msg[2]);
+   switch (ret.cmd) {
+      case node_msg::kind::publish:
+         ret.item = read_post(r);
+         break;
+      case node_msg::kind::remove:
+      {
+         ret.from = r.string();
+         ret.post_id = r.string();
+      } break;
+      case node_msg::kind::visualization:
+         ret.post_id = r.string();
+         break;
+      default:
+         throw std::runtime_error("parse_node_msg: unknown message.");
+   }
+
+   if (r.p != r.end)
+      throw std::runtime_error("parse_node_msg: trailing bytes.");
+
+   return ret;
+}
+
+} // occase
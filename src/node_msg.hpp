@@ -0,0 +1,50 @@
+#pragma once
+
+#include <string>
+#include <string_view>
+
+#include "post.hpp"
+
+namespace occase {
+
+// The messages nodes exchange on the posts channel, which are also
+// appended to the posts log.
+struct node_msg {
+   enum class kind
+   { unknown
+   , publish
+   , remove
+   , visualization
+   };
+
+   kind cmd = kind::unknown;
+
+   // The post of publish.
+   post item;
+
+   // The user that requests a removal.
+   std::string from;
+
+   // The post of remove and visualization.
+   std::string post_id;
+};
+
+// Serializes the message as json, e.g.
+//
+//    {"cmd":"delete","from":"...","post_id":"..."}
+//
+// or in the binary envelope
+//
+//    0x00, version, kind, fields
+//
+// where strings and vectors are prefixed by their size and integers
+// are varints, signed ones zigzag encoded. Json text never starts
+// with 0x00, so that both can be told apart.
+std::string serialize(node_msg const& m, bool binary);
+
+// Parses a message in either format. Json messages with other
+// commands have cmd unknown. Throws on invalid messages and binary
+// envelopes of other versions.
+node_msg parse_node_msg(std::string_view msg);
+
+} // occase
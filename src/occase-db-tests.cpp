@@ -1,14 +1,35 @@
+#include <set>
+#include <tuple>
+#include <chrono>
+#include <random>
+#include <limits>
+#include <numeric>
+#include <fstream>
 #include <iostream>
+#include <filesystem>
 #include <thread>
 
+#include <malloc.h>
+
 #include <boost/program_options/options_description.hpp>
 #include <boost/program_options/parsers.hpp>
 #include <boost/program_options/variables_map.hpp>
 
 #include "net.hpp"
 #include "post.hpp"
+#include "crypto.hpp"
 #include "system.hpp"
+#include "app_msg.hpp"
+#include "app_codec.hpp"
+#include "bitmap.hpp"
 #include "channel.hpp"
+#include "kernels.hpp"
+#include "node_msg.hpp"
+#include "snapshot.hpp"
+#include "responses.hpp"
+#include "slot_list.hpp"
+#include "query_cache.hpp"
+#include "compact_post.hpp"
 
 using tcp_socket = net::use_awaitable_t<>::as_default_on_t<tcp::socket>;
 
@@ -609,6 +630,19 @@ struct options {
 
 using namespace occase;
 
+post make_bench_post(std::mt19937& gen, int i)
+{
+   std::uniform_int_distribution<int> dist {0, 9};
+
+   post p;
+   p.id = std::to_string(i);
+   p.date = date_type {i};
+   p.visualizations = 0;
+   p.location = {dist(gen), dist(gen), dist(gen)};
+   p.product = {dist(gen), dist(gen), dist(gen)};
+   return p;
+}
+
 void channel_tests()
 {
    {  // query location and product.
@@ -667,10 +701,1945 @@ void channel_tests()
 
       auto const r3 = chn.query(p3);
       assert_true(std::size(r3) == 1u, "channel_tests");
-      assert_equal(r3.front().visualizations, 0, "channel_tests");
+      assert_equal(r3.front().visualizations, 10, "channel_tests");
+
+      // In any order, with posts missing and unknown ids.
+      chn.load_visualizations({{"3", 7}, {"x", 1}, {"2", 5}});
+      assert_equal(chn.query(p2).front().visualizations, 5, "channel_tests");
+      assert_equal(chn.query(p3).front().visualizations, 7, "channel_tests");
+      assert_equal(chn.query(p1).front().visualizations, 10, "channel_tests");
+
+      std::string cursor;
+      auto const top = chn.query(post{}, 1, cursor, channel::order_by::visualizations);
+      assert_equal(top.front().id, std::string {"1"}, "channel_tests");
+   }
+
+   { // Prefix index after removal and slot reuse.
+      post p1;
+      p1.id = "1";
+      p1.from = "a";
+      p1.location = {1, 2, 3};
+      p1.product = {4, 5};
+
+      post p2;
+      p2.id = "2";
+      p2.from = "a";
+      p2.location = {1, 2, 4};
+      p2.product = {4, 6};
+
+      post p3;
+      p3.id = "3";
+      p3.from = "b";
+      p3.location = {1, 3};
+      p3.product = {4, 5, 1};
+
+      channel chn;
+      chn.add_post(p1);
+      chn.add_post(p2);
+      chn.add_post(p3);
+
+      post q;
+      q.location = {1};
+      q.product = {4, 5};
+      assert_equal(chn.count(q), 2, "channel_tests (index)");
+
+      q.location = {1, 2, 3, 4};
+      q.product = {};
+      assert_true(std::empty(chn.query(q)), "channel_tests (index)");
+
+      assert_true(!chn.remove_post("1", "b", false), "channel_tests (index)");
+      assert_true(chn.remove_post("1", "a", false), "channel_tests (index)");
+      assert_true(std::empty(chn.get("1").id), "channel_tests (index)");
+
+      q.location = {1, 2};
+      assert_equal(chn.count(q), 1, "channel_tests (index)");
+
+      post p4;
+      p4.id = "4";
+      p4.location = {1, 2, 5};
+      chn.add_post(p4);
+
+      assert_equal(chn.count(q), 2, "channel_tests (index)");
+      assert_equal(chn.get("4").location, p4.location, "channel_tests (index)");
+      assert_equal(chn.count(post{}), 3, "channel_tests (index)");
+   }
+
+   { // Prefix counters must match a scan.
+      std::mt19937 gen {1};
+      std::uniform_int_distribution<int> dist {0, 9};
+
+      channel chn;
+      for (auto i = 0; i < 5000; ++i)
+         chn.add_post(make_bench_post(gen, i));
+
+      for (auto i = 0; i < 5000; i += 3)
+         chn.remove_post(std::to_string(i), "", true);
+
+      auto ok = true;
+      for (auto i = 0; i < 500; ++i) {
+         post q;
+         q.location.resize(i % 4);
+         q.product.resize((i / 4) % 4);
+         std::generate(std::begin(q.location), std::end(q.location), [&]{ return dist(gen); });
+         std::generate(std::begin(q.product), std::end(q.product), [&]{ return dist(gen); });
+         ok = ok && chn.count(q) == std::ssize(chn.query(q, 5000));
+      }
+
+      assert_true(ok, "channel_tests (counters)");
+   }
+
+   { // Facets
+      post p1;
+      p1.id = "1";
+      p1.location = {1, 2};
+      p1.product = {3, 4};
+
+      post p2;
+      p2.id = "2";
+      p2.location = {1, 3};
+      p2.product = {3, 5};
+
+      post p3;
+      p3.id = "3";
+      p3.location = {1, 3};
+      p3.product = {3, 4};
+
+      channel chn;
+      chn.add_post(p1);
+      chn.add_post(p2);
+      chn.add_post(p3);
+
+      post q;
+      q.location = {1};
+      q.product = {3};
+
+      code_counter::facet_type const loc {{2, 1}, {3, 2}};
+      code_counter::facet_type const prod {{4, 2}, {5, 1}};
+
+      auto const r1 = chn.facets(q);
+      assert_equal(r1.location, loc, "channel_tests (facets)");
+      assert_equal(r1.product, prod, "channel_tests (facets)");
+
+      q.product = {3, 5};
+      auto const r2 = chn.facets(q);
+      assert_equal(r2.location, {{3, 1}}, "channel_tests (facets)");
+      assert_true(std::empty(r2.product), "channel_tests (facets)");
+   }
+
+   { // ex_details
+      post p1;
+      p1.id = "1";
+      p1.location = {1};
+      p1.ex_details = {1, 2, 3};
+
+      post p2;
+      p2.id = "2";
+      p2.location = {1};
+      p2.ex_details = {1, 5, 3};
+
+      post p3;
+      p3.id = "3";
+      p3.location = {2};
+      p3.ex_details = {1, 2};
+
+      channel chn;
+      chn.add_post(p1);
+      chn.add_post(p2);
+      chn.add_post(p3);
+
+      post q;
+      q.ex_details = {1};
+      assert_equal(chn.count(q), 3, "channel_tests (details)");
+
+      q.ex_details = {-1, 2};
+      assert_equal(chn.count(q), 2, "channel_tests (details)");
+
+      q.location = {1};
+      q.ex_details = {1, -1, 3};
+      assert_equal(chn.count(q), 2, "channel_tests (details)");
+
+      q.ex_details = {-1, 2, 3};
+      auto const r = chn.query(q);
+      assert_true(std::size(r) == 1u, "channel_tests (details)");
+      assert_equal(r.front().id, p1.id, "channel_tests (details)");
+
+      q.location = {};
+      q.ex_details = {-1, 2};
+      auto const f = chn.facets(q);
+      assert_equal(f.location, {{1, 1}, {2, 1}}, "channel_tests (details)");
+
+      chn.remove_post("1", "", true);
+      q.ex_details = {1, 2, 3};
+      assert_equal(chn.count(q), 0, "channel_tests (details)");
+   }
+
+   { // in_details
+      channel chn;
+      for (auto i = 0; i < 100; ++i) {
+         post p;
+         p.id = std::to_string(i);
+         p.location = {i % 2};
+         p.in_details = {code_type(1) << (i % 8)};
+         if (i % 10 == 0)
+            p.in_details.push_back(1);
+
+         chn.add_post(p);
+      }
+
+      post q;
+      q.in_details = {0b11};
+      assert_equal(chn.count(q), 26, "channel_tests (features)");
+
+      q.location = {1};
+      assert_equal(chn.count(q), 13, "channel_tests (features)");
+
+      q.location = {};
+      q.in_details = {1, 1};
+      auto const r = chn.query(q);
+      assert_true(std::size(r) == 3u, "channel_tests (features)");
+
+      q.in_details = {0, 0, 1};
+      assert_equal(chn.count(q), 0, "channel_tests (features)");
+
+      chn.remove_post("0", "", true);
+      q.in_details = {0, 1};
+      assert_equal(chn.count(q), 9, "channel_tests (features)");
+   }
+
+   { // range_values
+      channel chn;
+      for (auto i = 0; i < 1000; ++i) {
+         post p;
+         p.id = std::to_string(i);
+         p.location = {i % 4};
+         p.range_values = {i, 2000 - i, i % 10};
+         chn.add_post(p);
+      }
+
+      post q;
+      q.range_values = {100, 199};
+      assert_equal(chn.count(q), 100, "channel_tests (ranges)");
+
+      q.range_values = {100, 199, 1850, 2000};
+      assert_equal(chn.count(q), 51, "channel_tests (ranges)");
+
+      q.location = {3};
+      q.range_values = {1, 0, 0, 5000, 3, 3};
+      assert_equal(chn.count(q), 50, "channel_tests (ranges)");
+
+      q.range_values = {1, 0, 0, 5000, 3, 3, 0, 10};
+      assert_true(std::empty(chn.query(q)), "channel_tests (ranges)");
+
+      q.location = {0};
+      q.range_values = {0, 7};
+      auto const r = chn.query(q);
+      assert_true(std::size(r) == 2u, "channel_tests (ranges)");
+
+      chn.remove_post("4", "", true);
+      assert_equal(chn.count(q), 1, "channel_tests (ranges)");
+   }
+
+   { // Codes that don't fit in a packed code.
+      std::vector<std::vector<int>> const codes
+      { {}
+      , {1}
+      , {1, 2}
+      , {1, 2, 3, 4}
+      , {1, 2, 3, 4, 5}
+      , {1, 2, 3, 4, 5, 6}
+      , {1, 40000}
+      , {1, -2, 3}
+      , {packed_value_max, 0}
+      };
+
+      channel chn;
+      for (auto i = 0U; i < std::size(codes); ++i) {
+         post p;
+         p.id = std::to_string(i);
+         p.location = codes[i];
+         p.product = codes[std::size(codes) - 1 - i];
+         p.range_values = {0};
+         chn.add_post(p);
+      }
+
+      auto child_of = [](auto const& code, auto const& prefix)
+      {
+         return std::size(prefix) <= std::size(code)
+             && std::equal(std::cbegin(prefix), std::cend(prefix), std::cbegin(code));
+      };
+
+      for (auto const& wanted : codes) {
+         auto const expected = std::count_if(
+            std::cbegin(codes), std::cend(codes),
+            [&](auto const& c) { return child_of(c, wanted); });
+
+         // The range makes the queries read the columns.
+         post q;
+         q.location = wanted;
+         q.range_values = {0, 0};
+         assert_equal(chn.count(q), int(expected), "channel_tests (packed codes)");
+
+         q.product = wanted;
+         q.location = {};
+         assert_equal(chn.count(q), int(expected), "channel_tests (packed codes)");
+      }
+
+      assert_equal(pack({}), packed_code {0}, "channel_tests (packed codes)");
+      assert_equal(pack({1, 2, 3, 4, 5}), packed_unfit, "channel_tests (packed codes)");
+      assert_equal(pack({-1}), packed_unfit, "channel_tests (packed codes)");
+   }
+
+   { // Pagination
+      channel chn;
+      for (auto i = 0; i < 1000; ++i) {
+         post p;
+         p.id = std::to_string(i);
+         p.location = {i % 2};
+         p.ex_details = {i % 3};
+         chn.add_post(p);
+      }
+
+      assert_true(std::size(chn.query(post{}, 10)) == 10u, "channel_tests (pages)");
+
+      auto paginate = [&](post const& q, int max)
+      {
+         std::set<std::string> ids;
+         std::string cursor;
+         do {
+            auto const r = chn.query(q, max, cursor);
+            if (std::ssize(r) > max)
+               return std::size_t {0};
+
+            for (auto const& p : r)
+               ids.insert(p.id);
+
+         } while (!std::empty(cursor));
+
+         return std::size(ids);
+      };
+
+      post q;
+      q.location = {1};
+      assert_equal(paginate(q, 30), std::size_t {500}, "channel_tests (pages)");
+      assert_equal(paginate(q, 500), std::size_t {500}, "channel_tests (pages)");
+
+      q.ex_details = {2};
+      assert_equal(paginate(q, 7), std::size_t {166}, "channel_tests (pages)");
+
+      q.location = {};
+      assert_equal(paginate(q, 100), std::size_t {333}, "channel_tests (pages)");
+
+      // The post the cursor refers to is removed before the next page.
+      std::string cursor;
+      auto const r1 = chn.query(q, 10, cursor);
+      chn.remove_post(r1.back().id, "", true);
+      auto const r2 = chn.query(q, 10, cursor);
+      assert_true(std::size(r2) == 10u && r2.front().id != r1.back().id, "channel_tests (pages)");
+   }
+
+   { // Ordered search
+      std::mt19937 gen {3};
+      std::uniform_int_distribution<int> dist {0, 49};
+
+      channel chn;
+      std::vector<post> all;
+      for (auto i = 0; i < 2000; ++i) {
+         auto p = make_bench_post(gen, i);
+         p.date = date_type {dist(gen)};
+         all.push_back(p);
+         chn.add_post(p);
+      }
+
+      for (auto i = 0; i < 3000; ++i) {
+         auto& p = all[dist(gen) * 40];
+         chn.on_visualization(p.id);
+         ++p.visualizations;
+      }
+
+      // Both orders are descending with ties broken by insertion
+      // order, newest first.
+      auto expected = [&](post const& q, channel::order_by by)
+      {
+         std::vector<std::tuple<long, int, std::string>> tmp;
+         for (auto i = 0; i < std::ssize(all); ++i) {
+            auto const& p = all[i];
+            auto const child_of = [](auto const& prefix, auto const& code)
+            {
+               return std::size(prefix) <= std::size(code)
+                   && std::equal(std::cbegin(prefix), std::cend(prefix), std::cbegin(code));
+            };
+
+            if (!child_of(q.location, p.location) || !child_of(q.product, p.product))
+               continue;
+
+            auto const key = by == channel::order_by::date
+                           ? p.date.count() : long {p.visualizations};
+            tmp.push_back({key, i, p.id});
+         }
+
+         std::sort(std::begin(tmp), std::end(tmp), std::greater<>{});
+
+         std::vector<std::string> ret;
+         for (auto const& e : tmp)
+            ret.push_back(std::get<2>(e));
+
+         return ret;
+      };
+
+      auto paginate = [&](post const& q, int max, channel::order_by by)
+      {
+         std::vector<std::string> ret;
+         std::string cursor;
+         do {
+            for (auto const& p : chn.query(q, max, cursor, by))
+               ret.push_back(p.id);
+         } while (!std::empty(cursor));
+
+         return ret;
+      };
+
+      for (auto by : {channel::order_by::date, channel::order_by::visualizations}) {
+         for (auto max : {1, 10, 3000}) {
+            post q;
+            assert_true(paginate(q, max, by) == expected(q, by), "channel_tests (ordered)");
+
+            // Narrow queries collect the matches instead of walking
+            // the order.
+            q.location = {1, 2};
+            assert_true(paginate(q, max, by) == expected(q, by), "channel_tests (ordered)");
+
+            q.product = {3};
+            assert_true(paginate(q, max, by) == expected(q, by), "channel_tests (ordered)");
+         }
+      }
+
+      assert_true(to_order_by("") == channel::order_by::none, "channel_tests (ordered)");
+      assert_true(to_order_by("date") == channel::order_by::date, "channel_tests (ordered)");
+
+      auto throws = false;
+      try {
+         to_order_by("price");
+      } catch (std::invalid_argument const&) {
+         throws = true;
+      }
+      assert_true(throws, "channel_tests (ordered)");
+   }
+
+   { // Expiration
+      channel chn;
+      for (auto i = 0; i < 100; ++i) {
+         post p;
+         p.id = std::to_string(i);
+         p.date = date_type {(i * 37) % 100};
+         p.location = {i % 4};
+         p.ex_details = {i % 2};
+         chn.add_post(p);
+      }
+
+      // Posts with date < 50 are expired.
+      auto const now = date_type {60};
+      auto const exp = date_type {10};
+
+      auto const r1 = chn.remove_expired_posts(now, exp, 30);
+      assert_true(std::size(r1) == 30u, "channel_tests (expiration)");
+
+      auto const r2 = chn.remove_expired_posts(now, exp, 30);
+      assert_true(std::size(r2) == 20u, "channel_tests (expiration)");
+
+      auto const r3 = chn.remove_expired_posts(now, exp, 30);
+      assert_true(std::empty(r3), "channel_tests (expiration)");
+
+      auto sorted = true;
+      for (auto i = 0; i < std::ssize(r1); ++i)
+         sorted = sorted && r1[i].date == date_type {i};
+
+      assert_true(sorted && r2.back().date == date_type {49}, "channel_tests (expiration)");
+      assert_equal(std::ssize(chn), 50L, "channel_tests (expiration)");
+      assert_equal(chn.count(post{}), 50, "channel_tests (expiration)");
+
+      post q;
+      q.ex_details = {1};
+      auto valid = true;
+      for (auto const& p : chn.query(q))
+         valid = valid && date_type {50} <= p.date;
+
+      assert_true(valid && std::size(chn.query(q)) == 25u, "channel_tests (expiration)");
+      assert_true(std::empty(chn.get(r1.front().id).id), "channel_tests (expiration)");
+
+      // Freed slots are reused by new posts.
+      post p;
+      p.id = "new";
+      p.date = date_type {100};
+      chn.add_post(p);
+      assert_true(chn.get("new").date == date_type {100}, "channel_tests (expiration)");
+   }
+
+   { // Bulk load
+      std::vector<std::string> msgs;
+      for (auto i = 0; i < 100; ++i) {
+         post p;
+         p.id = std::to_string(i);
+         p.date = date_type {(i * 37) % 100};
+         p.location = {i % 4};
+
+         json j;
+         j["cmd"] = "publish_internal";
+         j["post"] = p;
+         msgs.push_back(j.dump());
+      }
+
+      msgs.push_back("{");
+      msgs.push_back(R"({"cmd": "visualization", "post_id": "1"})");
+
+      for (auto threads : {1, 3, 200}) {
+         channel chn;
+         chn.add_post(post{});
+         chn.load(parse_posts(msgs, threads));
+
+         assert_equal(std::ssize(chn), 100L, "channel_tests (load)");
+
+         post q;
+         q.location = {3};
+         assert_equal(chn.count(q), 25, "channel_tests (load)");
+         assert_equal(chn.get("37").date, date_type {69}, "channel_tests (load)");
+
+         std::string cursor;
+         auto const r = chn.query(post{}, 1, cursor, channel::order_by::date);
+         assert_equal(r.front().date, date_type {99}, "channel_tests (load)");
+      }
+   }
+
+   { // Compaction
+      std::mt19937 gen {4};
+      channel chn;
+      std::vector<post> all;
+      for (auto i = 0; i < 4000; ++i) {
+         all.push_back(make_bench_post(gen, i));
+         chn.add_post(all.back());
+      }
+
+      // Not enough free slots yet.
+      for (auto i = 0; i < 1000; ++i)
+         chn.remove_post(std::to_string(i), "", true);
+
+      assert_true(!chn.compact(), "channel_tests (compaction)");
+
+      for (auto i = 1000; i < 3000; i += 2)
+         chn.remove_post(std::to_string(i), "", true);
+
+      for (auto i = 1001; i < 3000; i += 2)
+         chn.on_visualization(std::to_string(i));
+
+      post q;
+      q.location = {2};
+      std::string c1;
+      auto const before = chn.query(q, 100000);
+      auto const newest = chn.query(post{}, 10, c1, channel::order_by::date);
+      auto const n = chn.count(q);
+
+      for (auto i = 1001; i < 2000; i += 2)
+         chn.remove_post(std::to_string(i), "", true);
+
+      assert_true(chn.compact(), "channel_tests (compaction)");
+      assert_equal(std::ssize(chn), 1500L, "channel_tests (compaction)");
+
+      auto const after = chn.query(q, 100000);
+      auto same = true;
+      auto j = 0U;
+      for (auto const& p : before) {
+         if (std::stoi(p.id) < 2000)
+            continue;
+
+         same = same && j < std::size(after) && after[j++].id == p.id;
+      }
+
+      assert_true(same && j == std::size(after), "channel_tests (compaction)");
+      assert_true(chn.count(q) < n && chn.count(q) == std::ssize(after), "channel_tests (compaction)");
+      assert_equal(chn.get("2001").visualizations, 1, "channel_tests (compaction)");
+
+      std::string c2;
+      auto const newest2 = chn.query(post{}, 10, c2, channel::order_by::date);
+      assert_equal(newest2.front().id, newest.front().id, "channel_tests (compaction)");
+
+      // Lookups after compaction.
+      chn.on_visualization("3999");
+      assert_equal(chn.get("3999").visualizations, 1, "channel_tests (compaction)");
+      assert_true(chn.remove_post("3999", "", true), "channel_tests (compaction)");
+      assert_true(std::empty(chn.get("3999").id), "channel_tests (compaction)");
    }
 }
 
+void bitmap_tests()
+{
+   bitmap a;
+   bitmap b;
+   for (bitmap::value_type i = 0; i < 200000; i += 2)
+      a.add(i);
+
+   for (bitmap::value_type i = 0; i < 200000; i += 3)
+      b.add(i);
+
+   assert_true(a.contains(10) && !a.contains(11), "bitmap_tests");
+   assert_true(!a.add(10) && a.remove(10) && !a.contains(10), "bitmap_tests");
+   a.add(10);
+
+   auto const c = a & b;
+   assert_equal(std::size(c), std::size_t {33334}, "bitmap_tests");
+
+   auto ok = true;
+   bitmap::value_type last = 0;
+   auto f = [&](auto v)
+   {
+      ok = ok && v % 6 == 0 && (v == 0 || v > last);
+      last = v;
+   };
+
+   c.for_each(f);
+   assert_true(ok, "bitmap_tests");
+
+   // Makes the dense chunks sparse again.
+   for (bitmap::value_type i = 0; i < 200000; i += 2) {
+      if (i % 1000 != 0)
+         a.remove(i);
+   }
+
+   assert_equal(std::size(a), std::size_t {200}, "bitmap_tests");
+   assert_true(a.contains(1000) && !a.contains(1002), "bitmap_tests");
+   assert_equal(std::size(a & b), std::size_t {67}, "bitmap_tests");
+
+   // A chunk going back and forth around the conversion thresholds.
+   bitmap d;
+   for (bitmap::value_type i = 0; i < 4097; ++i)
+      d.add(2 * i);
+
+   for (auto k = 0; k < 3; ++k) {
+      for (bitmap::value_type i = 0; i < 1000; ++i)
+         d.remove(2 * i);
+
+      assert_true(!d.contains(0) && d.contains(2000), "bitmap_tests");
+
+      for (bitmap::value_type i = 0; i < 1000; ++i)
+         d.add(2 * i);
+
+      assert_true(d.contains(0) && !d.contains(1), "bitmap_tests");
+   }
+
+   assert_equal(std::size(d), std::size_t {4097}, "bitmap_tests");
+   assert_equal(std::size(d & d), std::size_t {4097}, "bitmap_tests");
+}
+
+// A post like the ones published by the apps, with images uploaded
+// to the mms host. There are 1000 authors.
+post make_full_post(std::mt19937& gen, int i)
+{
+   auto p = make_bench_post(gen, i);
+
+   pwd_gen pwdgen;
+   p.id = pwdgen.make(8);
+   p.from = make_hex_digest(std::to_string(i % 1000));
+   p.nick = "Seller " + std::to_string(i % 1000);
+   p.avatar = "https://lh3.googleusercontent.com/a/" + p.from;
+   p.description = std::string(150, 'd');
+   p.ex_details = {i % 3, i % 7, i % 11};
+   p.in_details = {code_type {1} << (i % 64), 5};
+   p.range_values = {i % 1000, 2000 + i % 20};
+
+   for (auto j = 0; j < 4; ++j) {
+      auto const filename = pwdgen.make(sz::mms_filename_size);
+      p.images.push_back("https://mms.occase.de/posts/imgs" + make_dir(filename) + "/" + filename + ".jpeg");
+   }
+
+   return p;
+}
+
+void compact_post_tests()
+{
+   std::mt19937 gen {7};
+   image_hosts hosts;
+   intern_table strings;
+
+   auto same = [&](post const& p)
+   {
+      compact_post const c {p, hosts, strings};
+      json const a = p;
+      json const b = c.decode(hosts);
+
+      std::string s;
+      c.write_json(hosts, s);
+      return a == b && s == a.dump();
+   };
+
+   auto const full = make_full_post(gen, 1);
+   assert_true(same(full), "compact_post_tests");
+   assert_equal(std::size(hosts), std::size_t {1}, "compact_post_tests");
+
+   compact_post const c {full, hosts, strings};
+   assert_equal(c.id(), full.id, "compact_post_tests");
+   assert_equal(c.from(), full.from, "compact_post_tests");
+   assert_equal(c.location(), full.location, "compact_post_tests");
+   assert_equal(c.product(), full.product, "compact_post_tests");
+
+   // Fields that are stored verbatim.
+   auto odd = full;
+   odd.id = "Not-A-Pwd";
+   odd.from = "ABCDEF";
+   odd.location = {-1, 1 << 30, -(1 << 30)};
+   odd.range_values = {std::numeric_limits<int>::min(), std::numeric_limits<int>::max()};
+   odd.in_details = {~code_type {0}};
+   odd.images = {"", "a.jpg", "https://mms.occase.de/posts/imgs/a/b/cd/abcdefgh.jpeg", "/posts/imgs/x/y/zz/xyzzzzzz.jpeg"};
+   odd.description = "\"quoted\"\n\t\x01 \\ ação";
+   odd.ex_details = {};
+   assert_true(same(odd), "compact_post_tests");
+
+   compact_post const o {odd, hosts, strings};
+   assert_equal(o.id(), odd.id, "compact_post_tests");
+   assert_equal(o.from(), odd.from, "compact_post_tests");
+
+   // Empty id and from, as in some tests.
+   assert_true(same(post{}), "compact_post_tests");
+
+   auto const copy = o;
+   assert_true(json(copy.decode(hosts)) == json(odd), "compact_post_tests");
+}
+
+// The serialized search responses must be the same as dumping the
+// posts.
+void query_json_tests()
+{
+   std::mt19937 gen {9};
+   channel chn;
+   for (auto i = 0; i < 2000; ++i)
+      chn.add_post(make_full_post(gen, i));
+
+   for (auto i = 0; i < 500; ++i)
+      chn.on_visualization(chn.query(post{}, 1).front().id);
+
+   auto same = [&](post const& q, channel::order_by by)
+   {
+      std::string c1;
+      std::string c2;
+      auto ok = true;
+      do {
+         json const j = chn.query(q, 30, c1, by);
+         std::string s;
+         chn.query_json(q, 30, c2, by, s);
+         ok = ok && s == j.dump() && c1 == c2;
+      } while (!std::empty(c1) && ok);
+
+      return ok;
+   };
+
+   post q;
+   q.location = {1};
+   for (auto by : {channel::order_by::none, channel::order_by::date, channel::order_by::visualizations})
+      assert_true(same(q, by), "query_json_tests");
+
+   // No match.
+   q.location = {100};
+   assert_true(same(q, channel::order_by::none), "query_json_tests");
+
+   chn.remove_expired_posts(date_type {1900}, date_type {0}, 1900);
+   chn.compact();
+   assert_true(same(post{}, channel::order_by::date), "query_json_tests");
+}
+
+void intern_tests()
+{
+   auto table = std::make_unique<intern_table>();
+
+   auto a = table->intern("abc");
+   auto b = table->intern("abc");
+   auto c = table->intern("def");
+   assert_true(&a.str() == &b.str(), "intern_tests");
+   assert_equal(table->size(), std::size_t {2}, "intern_tests");
+   assert_true(std::empty(table->intern("")) && table->size() == 2, "intern_tests");
+
+   // The string is released with the last handle.
+   c = {};
+   assert_equal(table->size(), std::size_t {1}, "intern_tests");
+
+   a = b;
+   b = std::move(a);
+   assert_equal(b.str(), std::string {"abc"}, "intern_tests");
+   assert_equal(table->size(), std::size_t {1}, "intern_tests");
+
+   // Lookup by plain strings, like the worker sessions.
+   std::unordered_map<interned_string, int, interned_hash, std::equal_to<>> m;
+   m.insert({b, 1});
+   assert_true(m.find(std::string {"abc"}) != std::end(m), "intern_tests");
+   assert_true(m.find(std::string {"def"}) == std::end(m), "intern_tests");
+
+   // Handles may outlive the table.
+   table.reset();
+   auto d = b;
+   assert_equal(d.str(), std::string {"abc"}, "intern_tests");
+
+   // The authors of the posts are shared.
+   std::mt19937 gen {8};
+   channel chn;
+   for (auto i = 0; i < 3000; ++i)
+      chn.add_post(make_full_post(gen, i));
+
+   auto const ids = chn.intern(make_hex_digest(std::to_string(7)));
+   assert_equal(chn.interned_size(), std::size_t {3000}, "intern_tests");
+
+   for (auto i = 0; i < 3000; i += 2)
+      chn.remove_expired_posts(date_type {i + 2}, date_type {0}, 2);
+
+   assert_equal(chn.interned_size(), std::size_t {1}, "intern_tests");
+   assert_equal(ids.str(), make_hex_digest(std::to_string(7)), "intern_tests");
+}
+
+void query_cache_tests()
+{
+   // Trailing fields that match any value are ignored.
+   post a;
+   a.location = {1, 2};
+   post b = a;
+   b.ex_details = {-1, -5};
+   b.in_details = {0};
+   b.range_values = {5, 1, 3};
+   assert_equal(canonical_query(a), canonical_query(b), "query_cache_tests");
+   b.range_values = {1, 5};
+   assert_true(canonical_query(a) != canonical_query(b), "query_cache_tests");
+
+   query_cache cache {2};
+   cache.insert("a", 1, "1");
+   cache.insert("b", 1, "2");
+   assert_true(cache.find("a", 1) != nullptr, "query_cache_tests");
+   cache.insert("c", 1, "3");
+
+   // b was the least recently used.
+   assert_true(cache.find("b", 1) == nullptr, "query_cache_tests");
+   assert_equal(*cache.find("c", 1), std::string {"3"}, "query_cache_tests");
+
+   // Stale entries are released.
+   assert_true(cache.find("a", 2) == nullptr, "query_cache_tests");
+   assert_equal(cache.size(), std::size_t {1}, "query_cache_tests");
+   assert_equal(cache.hits(), std::uint64_t {2}, "query_cache_tests");
+   assert_equal(cache.misses(), std::uint64_t {2}, "query_cache_tests");
+
+   // Only changes to the posts of the query subtree invalidate.
+   auto make = [](std::vector<int> location, std::string id)
+   {
+      post p;
+      p.location = location;
+      p.product = {1};
+      p.id = id;
+      return p;
+   };
+
+   channel chn;
+   chn.add_post(make({1, 1}, "a"));
+   chn.add_post(make({2, 1}, "b"));
+
+   post q;
+   q.location = {1};
+   auto const g = chn.generation();
+   auto valid = [&]
+      { return chn.generation(q) <= g; };
+
+   chn.add_post(make({2, 2}, "c"));
+   chn.on_visualization("b");
+   chn.remove_post("c", "", true);
+   assert_true(valid(), "query_cache_tests");
+
+   chn.add_post(make({1, 3}, "d"));
+   assert_true(!valid(), "query_cache_tests");
+
+   // Views don't invalidate, loading the visualizations does.
+   auto const h = chn.generation();
+   chn.on_visualization("a");
+   assert_true(chn.generation(q) <= h, "query_cache_tests");
+   chn.load_visualizations({{"a", 5}});
+   assert_true(chn.generation(q) > h, "query_cache_tests");
+
+   // Queries without posts depend on the nearest ancestor.
+   q.location = {1, 7};
+   auto const k = chn.generation();
+   chn.add_post(make({2, 3}, "e"));
+   assert_true(chn.generation(q) <= k, "query_cache_tests");
+   chn.add_post(make({1, 7, 1}, "f"));
+   assert_true(chn.generation(q) > k, "query_cache_tests");
+   chn.remove_post("f", "", true);
+   assert_true(chn.generation(q) > k, "query_cache_tests");
+
+   // Loading replaces all posts.
+   auto const l = chn.generation();
+   chn.load({});
+   assert_true(chn.generation(q) > l, "query_cache_tests");
+}
+
+void app_msg_tests()
+{
+   auto throws = [](auto f)
+   {
+      try {
+         f();
+      } catch (std::exception const&) {
+         return true;
+      }
+
+      return false;
+   };
+
+   std::string const text =
+      " {\"cmd\" : \"message\", \"id\":-12, \"post\":{\"a\":[1,\"}\",{}]},"
+      "\"message\":\"\\\"\\u00e9\\ud83d\\ude00\\n\", \"to\":\"def\"} ";
+
+   app_msg m;
+   assert_true(m.parse(text), "app_msg_tests");
+   assert_true(m.cmd() == app_cmd::message, "app_msg_tests");
+   assert_equal(m.get_int("id"), -12, "app_msg_tests");
+   assert_true(m.raw("post") == R"({"a":[1,"}",{}]})", "app_msg_tests");
+   assert_true(m.get_string("to") == "def", "app_msg_tests");
+
+   auto const j = json::parse(text);
+   assert_equal(std::string {m.get_string("message")}, j.at("message").get<std::string>(), "app_msg_tests");
+
+   assert_true(throws([&]{ m.get_string("id"); }), "app_msg_tests");
+   assert_true(throws([&]{ m.get_int("to"); }), "app_msg_tests");
+   assert_true(throws([&]{ m.raw("user"); }), "app_msg_tests");
+   assert_true(!m.contains("user"), "app_msg_tests");
+
+   for (auto const* e : {"", "[]", "{", R"({"a":1)", R"({"a" 1})", R"({"a":1} x)", R"({"a":"b})", R"({"a":})"})
+      assert_true(!m.parse(e), "app_msg_tests");
+
+   // Everything json::parse rejects is rejected, also in nested
+   // values.
+   std::vector<std::string> const invalid
+   { R"({"a":tru})", R"({"a":1x})", R"({"a":01})", R"({"a":-})", R"({"a":1.})"
+   , R"({"a":1e})", R"({"a":.5})", R"({"a":+1})", R"({"a":nul})", R"({"a":True})"
+   , R"({"a":[1,]})", R"({"a":[1 2]})", R"({"a":{"b"}})", R"({"a":{1:2}})"
+   , R"({"a":{"b":tru}})", R"({"a":[{"b":[x]}]})", R"({"a":[}})", R"({"a":"\x"})"
+   , R"({"a":"\u12"})", R"({"a":"\ud800"})", R"({"a":"\udc00"})", R"({"a":"\ud800A"})"
+   , "{\"a\":\"\x01\"}", "{\"a\":\"\xff\"}", "{\"a\":\"\xc3\"}"
+   };
+
+   for (auto const& e : invalid) {
+      assert_true(!m.parse(e), "app_msg_tests");
+      assert_true(!json::accept(e), "app_msg_tests");
+   }
+
+   std::vector<std::string> const valid
+   { R"({"a":true,"b":false,"c":null,"d":-0,"e":1.5e+10,"f":2E-3,"g":0.25})"
+   , R"({"a":[],"b":{},"c":[{"d":[1,"]",{"e":null}]}],"f":"\/\b\f\n\r\t"})"
+   , "{\"a\":\"\xc3\xa9\xf0\x9f\x98\x80\"}"
+   };
+
+   for (auto const& e : valid)
+      assert_true(m.parse(e) && json::accept(e), "app_msg_tests");
+
+   std::string deep = "{\"a\":";
+   deep += std::string(100, '[');
+   deep += std::string(100, ']');
+   deep += "}";
+   assert_true(!m.parse(deep), "app_msg_tests");
+
+   // Duplicate keys would be read with one value and forwarded with
+   // another.
+   assert_true(!m.parse(R"({"cmd":"message","from":"a","to":"b","from":"c"})"), "app_msg_tests");
+   assert_true(!m.parse(R"({"cmd":"message","from":"a","from":"c"})"), "app_msg_tests");
+   assert_true(!m.parse(R"({"cmd":"message","fr\u006fm":"a","from":"c"})"), "app_msg_tests");
+   assert_true(m.parse(R"({"a":{"b":1,"b":2},"b":3})"), "app_msg_tests");
+
+   assert_true(m.parse(" {} ") && m.cmd() == app_cmd::unknown, "app_msg_tests");
+
+   std::string many = "{";
+   for (auto i = 0; i <= app_msg::max_fields; ++i)
+      many += "\"" + std::to_string(i) + "\":" + std::to_string(i) + ",";
+   many.back() = '}';
+   assert_true(!m.parse(many), "app_msg_tests");
+
+   assert_true(to_app_cmd("login") == app_cmd::login, "app_msg_tests");
+   assert_true(to_app_cmd("presence") == app_cmd::presence, "app_msg_tests");
+   assert_true(to_app_cmd("publish") == app_cmd::publish, "app_msg_tests");
+   assert_true(to_app_cmd("publisx") == app_cmd::unknown, "app_msg_tests");
+
+   // Forwarding rewrites the fields like setting them in the document.
+   auto rewrite = [&](std::string const& msg)
+   {
+      assert_true(m.parse(msg), "app_msg_tests");
+      std::string out;
+      m.rewrite({{"from", "a\"b"}, {"to", "c"}}, out);
+
+      auto j = json::parse(msg);
+      j["from"] = "a\"b";
+      j["to"] = "c";
+      return json::parse(out) == j;
+   };
+
+   assert_true(rewrite(text), "app_msg_tests");
+   assert_true(rewrite(R"({"cmd":"presence","to":"x","from":"y"})"), "app_msg_tests");
+   assert_true(rewrite(R"({"cmd":"message","message":{"to":1}})"), "app_msg_tests");
+   assert_true(rewrite(" { } "), "app_msg_tests");
+
+   // The rest of the message is copied verbatim.
+   m.parse(R"({"to": "x", "message": "\u00e9 "})");
+   std::string out;
+   m.rewrite({{"to", "y"}}, out);
+   assert_equal(out, std::string {R"({"to": "y", "message": "\u00e9 "})"}, "app_msg_tests");
+}
+
+void app_codec_tests()
+{
+   std::mt19937 gen {3};
+
+   json chat;
+   chat["cmd"] = "message";
+   chat["from"] = make_hex_digest("a");
+   chat["to"] = make_hex_digest("b");
+   chat["post_id"] = "abcdefgh";
+   chat["id"] = 12;
+   chat["refers_to"] = -1;
+   chat["message"] = "Is it still available? \u00e9\n";
+   chat["unknown_field"] = {{"a", nullptr}, {"b", {true, false, -40000, 70000, 5000000000LL}}};
+
+   json publish;
+   publish["cmd"] = "publish";
+   publish["post"] = make_full_post(gen, 3);
+
+   json odd;
+   odd["escaped"] = "a\"b\\c\n\u00e9\U0001f600";
+   odd["numbers"] = {0, -0.0, 1.5, -2.5e-300, 1e300, std::numeric_limits<std::uint64_t>::max(), std::numeric_limits<std::int64_t>::min()};
+   odd["empty"] = {{"a", json::array()}, {"b", json::object()}};
+   for (auto i = 0; i < 20; ++i)
+      odd["many"][std::to_string(i)] = json::array({i, std::string(i * 20, 'x')});
+
+   for (auto const* j : {&chat, &publish, &odd}) {
+      auto const text = j->dump();
+      auto const bytes = to_binary(text);
+      assert_true(std::size(bytes) < std::size(text), "app_codec_tests");
+      assert_equal(json::parse(from_binary(bytes)), *j, "app_codec_tests");
+   }
+
+   // Floating point values are written back as json::dump does, json
+   // comparison alone would not tell 1.0 from 1.
+   std::string const floats = R"({"a":1.0,"b":-0.0,"c":1e+16,"d":0.1,"e":[100.0,2.5e-05]})";
+   assert_equal(from_binary(to_binary(floats)), json::parse(floats).dump(), "app_codec_tests");
+   assert_equal(json::parse(floats).dump(), floats, "app_codec_tests");
+
+   // Text is transcoded as the app sent it, with whitespace.
+   std::string const spaced = " { \"a\" : [ 1 , { } , \"x\\u0041\" ] , \"b\" : null } ";
+   assert_equal(json::parse(from_binary(to_binary(spaced))), json::parse(spaced), "app_codec_tests");
+
+   for (auto const* e : {"", R"({"a":tru})", R"({"a":1} x)", R"({"a":[1,]})"}) {
+      auto to_binary_throws = false;
+      try {
+         to_binary(e);
+      } catch (std::exception const&) {
+         to_binary_throws = true;
+      }
+
+      assert_true(to_binary_throws, "app_codec_tests");
+   }
+
+   auto throws = [](std::string_view bytes)
+   {
+      try {
+         from_binary(bytes);
+      } catch (std::exception const&) {
+         return true;
+      }
+
+      return false;
+   };
+
+   auto const bytes = to_binary(chat.dump());
+   assert_true(throws(bytes.substr(0, std::size(bytes) - 1)), "app_codec_tests");
+   assert_true(throws(bytes + "x"), "app_codec_tests");
+   assert_true(throws("\x81\x7f\x01"), "app_codec_tests");
+   assert_true(throws(std::string(64, '\x91')), "app_codec_tests");
+
+   assert_true(offers_binary("chat, occase.msgpack.v1"), "app_codec_tests");
+   assert_true(!offers_binary("occase.msgpack"), "app_codec_tests");
+   assert_true(!offers_binary(""), "app_codec_tests");
+}
+
+void responses_tests()
+{
+   std::string const odd = "a\"b\\c/\n\t\b\f\r\x01\x1f\x7f \xc3\xa9 \xf0\x9f\x98\x80";
+
+   auto same = [](auto f, json const& j)
+   {
+      std::string out = "x";
+      f(out);
+      return out == "x" + j.dump();
+   };
+
+   for (auto ok : {true, false}) {
+      json j;
+      j["cmd"] = "login_ack";
+      j["result"] = ok ? "ok" : "fail";
+      assert_true(same([&](auto& out) { write_login_ack(out, ok); }, j), "responses_tests");
+   }
+
+   json ack;
+   ack["cmd"] = "message";
+   ack["from"] = odd;
+   ack["to"] = "to";
+   ack["post_id"] = odd;
+   ack["ack_id"] = -3;
+   ack["type"] = "server_ack";
+   ack["result"] = "ok";
+   assert_true(same([&](auto& out) { write_server_ack(out, odd, "to", odd, -3); }, ack), "responses_tests");
+
+   json pub;
+   pub["cmd"] = "publish_ack";
+   pub["result"] = "ok";
+   pub["id"] = odd;
+   pub["date"] = 1600000000L;
+   pub["admin_id"] = "admin";
+   assert_true(same([&](auto& out) { write_publish_ack(out, odd, 1600000000L, "admin"); }, pub), "responses_tests");
+
+   json fail;
+   fail["cmd"] = "publish_ack";
+   fail["result"] = "fail";
+   fail["reason"] = odd;
+   assert_true(same([&](auto& out) { write_publish_fail(out, odd); }, fail), "responses_tests");
+
+   json id;
+   id["result"] = "ok";
+   id["user"] = "user";
+   id["key"] = odd;
+   id["user_id"] = "id";
+   assert_true(same([&](auto& out) { write_user_id(out, "user", odd, "id"); }, id), "responses_tests");
+
+   for (auto const* cursor : {"", "10:2"}) {
+      json search;
+      if (*cursor)
+         search["cursor"] = cursor;
+      search["posts"] = json::array({1, 2});
+      assert_true(same([&](auto& out) { write_search_response(out, cursor, "[1,2]"); }, search), "responses_tests");
+   }
+
+   // Invalid UTF-8 is rejected like json::dump does.
+   for (auto const* e : {"\xc3", "\xc0\x80", "\xed\xa0\x80", "\xf4\x90\x80\x80", "\x80", "\xe0\x80\x80"}) {
+      auto dump_throws = false;
+      try {
+         json {e}.dump();
+      } catch (std::exception const&) {
+         dump_throws = true;
+      }
+
+      auto write_throws = false;
+      try {
+         std::string out;
+         write_publish_fail(out, e);
+      } catch (std::exception const&) {
+         write_throws = true;
+      }
+
+      assert_true(dump_throws && write_throws, "responses_tests");
+   }
+}
+
+void node_msg_tests()
+{
+   auto throws = [](auto f)
+   {
+      try {
+         f();
+      } catch (std::exception const&) {
+         return true;
+      }
+
+      return false;
+   };
+
+   std::mt19937 gen {4};
+
+   node_msg pub;
+   pub.cmd = node_msg::kind::publish;
+   pub.item = make_full_post(gen, 7);
+   pub.item.date = date_type {1600000000};
+   pub.item.visualizations = -2;
+   pub.item.in_details = {0, std::numeric_limits<code_type>::max()};
+
+   node_msg del;
+   del.cmd = node_msg::kind::remove;
+   del.from = make_hex_digest("a");
+   del.post_id = "abcdefgh";
+
+   node_msg vis;
+   vis.cmd = node_msg::kind::visualization;
+   vis.post_id = "abcdefgh";
+
+   auto same = [](node_msg const& a, node_msg const& b)
+   {
+      return a.cmd == b.cmd
+          && json(a.item) == json(b.item)
+          && a.from == b.from
+          && a.post_id == b.post_id;
+   };
+
+   for (auto const* m : {&pub, &del, &vis}) {
+      auto const text = serialize(*m, false);
+      auto const bytes = serialize(*m, true);
+      assert_true(std::size(bytes) < std::size(text), "node_msg_tests");
+      assert_true(same(parse_node_msg(text), *m), "node_msg_tests");
+      assert_true(same(parse_node_msg(bytes), *m), "node_msg_tests");
+
+      // Truncated envelopes are rejected.
+      for (auto n : {std::size(bytes) - 1, std::size_t {2}})
+         assert_true(throws([&]{ parse_node_msg(bytes.substr(0, n)); }), "node_msg_tests");
+   }
+
+   // The json of older nodes.
+   json j;
+   j["cmd"] = "publish_internal";
+   j["post"] = pub.item;
+   assert_true(same(parse_node_msg(j.dump()), pub), "node_msg_tests");
+   assert_equal(serialize(pub, false), j.dump(), "node_msg_tests");
+   assert_true(parse_node_msg(R"({"cmd":"other"})").cmd == node_msg::kind::unknown, "node_msg_tests");
+
+   // Other versions and kinds.
+   auto bytes = serialize(vis, true);
+   bytes[1] = 2;
+   assert_true(throws([&]{ parse_node_msg(bytes); }), "node_msg_tests");
+   bytes[1] = 1;
+   bytes[2] = 9;
+   assert_true(throws([&]{ parse_node_msg(bytes); }), "node_msg_tests");
+}
+
+void snapshot_tests()
+{
+   std::mt19937 gen {6};
+   channel chn;
+   for (auto i = 0; i < 1000; ++i) {
+      auto p = make_bench_post(gen, 1000 - i);
+      p.from = "from" + std::to_string(i);
+      p.description = std::string(i % 50, 'x');
+      p.ex_details = {i % 3, i % 7};
+      p.in_details = {code_type {1} << (i % 64)};
+      p.range_values = {i, -i};
+      p.images = {"a.jpg", "b.jpg"};
+      p.visualizations = i % 11;
+      chn.add_post(p);
+   }
+
+   auto const path = "occase-db-tests.snapshot";
+   write_snapshot(path, chn, date_type {42});
+   auto const s = read_snapshot(path);
+
+   assert_equal(s.time, date_type {42}, "snapshot_tests");
+   assert_equal(std::size(s.posts), std::size_t {1000}, "snapshot_tests");
+
+   auto same = true;
+   for (auto const& p : s.posts) {
+      json const a = p;
+      json const b = chn.get(p.id);
+      same = same && a == b;
+   }
+
+   auto const sorted =
+      std::is_sorted(std::cbegin(s.posts), std::cend(s.posts), comp_post_date_less{});
+
+   assert_true(same && sorted, "snapshot_tests");
+
+   // Reconciliation with the ids in redis.
+   channel other;
+   other.load(s.posts);
+
+   std::vector<std::string> ids {"new1", "new2"};
+   for (auto i = 2; i <= 1000; ++i)
+      ids.push_back(std::to_string(i));
+
+   auto const missing = other.reconcile(ids);
+   assert_true(missing == std::vector<std::string>{"new1", "new2"}, "snapshot_tests");
+   assert_equal(std::ssize(other), 999L, "snapshot_tests");
+   assert_true(std::empty(other.get("1").id), "snapshot_tests");
+
+   // Truncated and invalid files.
+   std::filesystem::resize_file(path, 1000);
+   auto throws = 0;
+   try { read_snapshot(path); } catch (std::exception const&) { ++throws; }
+
+   std::ofstream {path} << "not a snapshot";
+   try { read_snapshot(path); } catch (std::exception const&) { ++throws; }
+
+   // A post whose images claim far more entries than the file has.
+   {
+      std::ofstream ofs {path, std::ios::binary | std::ios::trunc};
+      auto put = [&](auto v)
+         { ofs.write(reinterpret_cast<char const*>(&v), sizeof v); };
+
+      ofs << "ocsn";
+      put(std::uint32_t {1});
+      put(std::int64_t {42});
+      put(std::uint64_t {1});
+      put(std::int64_t {0});
+      put(std::int32_t {0});
+      for (auto i = 0; i < 10; ++i)
+         put(std::uint32_t {0});
+      put(std::numeric_limits<std::uint32_t>::max());
+   }
+
+   try { read_snapshot(path); } catch (std::runtime_error const&) { ++throws; }
+
+   std::filesystem::remove(path);
+   try { read_snapshot(path); } catch (std::exception const&) { ++throws; }
+
+   assert_equal(throws, 4, "snapshot_tests");
+}
+
+void slot_list_tests()
+{
+   std::mt19937 gen {5};
+   std::uniform_int_distribution<slot_type> dist {0, 20000};
+
+   slot_list l;
+   std::set<slot_type> s;
+   for (auto i = 0; i < 50000; ++i) {
+      auto const v = dist(gen);
+      if (i % 3 == 2)
+         assert_equal(l.erase(v), s.erase(v) == 1, "slot_list_tests");
+      else
+         assert_equal(l.insert(v), s.insert(v).second, "slot_list_tests");
+   }
+
+   assert_equal(std::size(l), std::size(s), "slot_list_tests");
+
+   for (slot_type from : {0U, 1U, 777U, 15000U, 20000U, 30000U}) {
+      std::vector<slot_type> got;
+      auto f = [&](auto begin, auto end)
+      {
+         got.insert(std::end(got), begin, end);
+         return true;
+      };
+
+      l.for_each_range(from, f);
+      std::vector<slot_type> expected(s.lower_bound(from), std::cend(s));
+      assert_true(got == expected, "slot_list_tests");
+   }
+
+   // Removing almost everything.
+   for (auto v : s) {
+      if (v % 100 != 0)
+         l.erase(v);
+   }
+
+   std::vector<slot_type> rest;
+   l.for_each([&](auto v) { rest.push_back(v); });
+
+   auto ok = std::is_sorted(std::cbegin(rest), std::cend(rest));
+   for (auto v : rest)
+      ok = ok && v % 100 == 0;
+
+   assert_true(ok && std::size(rest) == std::size(l), "slot_list_tests");
+}
+
+void kernels_tests()
+{
+   std::mt19937_64 gen {1};
+   std::vector<std::uint64_t> column(1003);
+   std::generate(std::begin(column), std::end(column), [&]{ return gen() & gen() & gen(); });
+
+   std::vector<slot_type> slots(std::size(column));
+   std::iota(std::begin(slots), std::end(slots), 0);
+   std::shuffle(std::begin(slots), std::end(slots), gen);
+
+   std::vector<slot_type> r1;
+   std::vector<slot_type> r2;
+   for (std::uint64_t mask = 1; mask != 0; mask <<= 7) {
+      auto const* begin = slots.data();
+      auto const* end = slots.data() + std::size(slots);
+      any_of_scalar(column.data(), begin, end, mask, r1);
+      any_of_avx2(column.data(), begin, end, mask, r2);
+   }
+
+   assert_true(!std::empty(r1) && r1 == r2, "kernels_tests");
+
+   // Packed codes with about one in ten that doesn't fit.
+   std::uniform_int_distribution<int> dist {0, 3};
+   std::vector<packed_code> codes(std::size(column));
+   for (auto& c : codes) {
+      std::vector<int> code(dist(gen));
+      for (auto& v : code)
+         v = dist(gen);
+
+      c = gen() % 10 == 0 ? packed_unfit : pack(code);
+   }
+
+   std::vector<slot_type> r3;
+   r1.clear();
+   r2.clear();
+   for (auto const& prefix : std::vector<std::vector<int>> {{}, {1}, {2, 3}, {0, 0, 0}, {1, 2, 3, 4, 5}}) {
+      auto const* begin = slots.data();
+      auto const* end = slots.data() + std::size(slots);
+      auto const value = pack(prefix);
+      auto const mask = prefix_mask(std::size(prefix));
+      prefix_of_scalar(codes.data(), begin, end, value, mask, r1);
+
+      if (has_avx2())
+         prefix_of_avx2(codes.data(), begin, end, value, mask, r2);
+      else
+         prefix_of_scalar(codes.data(), begin, end, value, mask, r2);
+
+      if (has_avx512())
+         prefix_of_avx512(codes.data(), begin, end, value, mask, r3);
+      else
+         prefix_of_scalar(codes.data(), begin, end, value, mask, r3);
+   }
+
+   assert_true(!std::empty(r1) && r1 == r2 && r1 == r3, "kernels_tests (prefix_of)");
+}
+
+// Throughput of the kernels in posts per second.
+void kernels_benchmark()
+{
+   using namespace std::chrono;
+
+   auto constexpr size = 1000000;
+   auto constexpr repeat = 100;
+
+   std::mt19937_64 gen {1};
+   std::vector<std::uint64_t> column(size);
+   std::generate(std::begin(column), std::end(column), [&]{ return gen() & gen() & gen() & gen(); });
+
+   std::vector<slot_type> slots(size);
+   std::iota(std::begin(slots), std::end(slots), 0);
+
+   auto bench = [&](auto kernel, char const* name)
+   {
+      std::vector<slot_type> out;
+      out.reserve(size);
+
+      auto const t0 = steady_clock::now();
+      for (auto i = 0; i < repeat; ++i) {
+         out.clear();
+         kernel(column.data(), slots.data(), slots.data() + size, 1ULL << i % 64, out);
+      }
+
+      auto const t1 = steady_clock::now();
+      auto const s = duration_cast<duration<double>>(t1 - t0).count();
+      std::cout << name << '\t' << (double(size) * repeat / s) << " posts/s" << std::endl;
+   };
+
+   bench(any_of_scalar, "any_of scalar");
+   if (has_avx2())
+      bench(any_of_avx2, "any_of avx2");
+
+   // Location-like codes with three levels of ten values.
+   std::vector<packed_code> codes(size);
+   for (auto& c : codes)
+      c = pack({int(gen() % 10), int(gen() % 10), int(gen() % 10)});
+
+   auto const value = pack({3, 5});
+   auto const mask = prefix_mask(2);
+
+   auto prefix_bench = [&](auto kernel, char const* name)
+   {
+      bench([&](auto const*, auto const* begin, auto const* end, auto, auto& out)
+         { kernel(codes.data(), begin, end, value, mask, out); }, name);
+   };
+
+   prefix_bench(prefix_of_scalar, "prefix_of scalar");
+   if (has_avx2())
+      prefix_bench(prefix_of_avx2, "prefix_of avx2");
+
+   if (has_avx512())
+      prefix_bench(prefix_of_avx512, "prefix_of avx512");
+}
+
+// Measures the search latency of the channel against the catalog
+// size.
+void channel_benchmark()
+{
+   using namespace std::chrono;
+
+   auto constexpr n_queries = 1000;
+   std::mt19937 gen {1};
+   std::uniform_int_distribution<int> dist {0, 9};
+
+   std::cout << "posts\tsearch (us)\tcount (us)\tnewest (us)" << std::endl;
+
+   for (auto size : {1000, 10000, 100000, 1000000}) {
+      channel chn;
+      for (auto i = 0; i < size; ++i)
+         chn.add_post(make_bench_post(gen, i));
+
+      std::vector<post> queries(n_queries);
+      for (auto& q : queries) {
+         q.location = {dist(gen), dist(gen)};
+         q.product = {dist(gen)};
+      }
+
+      std::size_t found = 0;
+      auto const t0 = steady_clock::now();
+      for (auto const& q : queries)
+         found += std::size(chn.query(q, size));
+
+      auto const t1 = steady_clock::now();
+      for (auto const& q : queries)
+         found -= chn.count(q);
+
+      auto const t2 = steady_clock::now();
+
+      // The home feed: the newest posts of the whole catalog.
+      std::size_t newest_found = 0;
+      for (auto i = 0; i < n_queries; ++i) {
+         std::string cursor;
+         newest_found += std::size(chn.query(post{}, 30, cursor, channel::order_by::date));
+      }
+
+      auto const t3 = steady_clock::now();
+
+      auto const search = duration_cast<microseconds>(t1 - t0).count();
+      auto const count = duration_cast<microseconds>(t2 - t1).count();
+      auto const newest = duration_cast<microseconds>(t3 - t2).count();
+
+      std::cout << size
+                << '\t' << double(search) / n_queries
+                << '\t' << double(count) / n_queries
+                << '\t' << double(newest) / n_queries
+                << std::endl;
+
+      assert_true(found == 0, "channel_benchmark");
+      assert_true(newest_found == 30 * n_queries, "channel_benchmark");
+   }
+}
+
+// Measures the publish throughput against the number of resident
+// posts. Each publication replaces the oldest post, like on a node
+// that removes expired posts, so that slots are reused.
+void publish_benchmark()
+{
+   using namespace std::chrono;
+
+   auto constexpr n_publish = 20000;
+   std::mt19937 gen {1};
+
+   std::cout << "posts\tpublish (posts/s)" << std::endl;
+
+   for (auto size : {10000, 100000, 1000000}) {
+      channel chn;
+      for (auto i = 0; i < size; ++i)
+         chn.add_post(make_bench_post(gen, i));
+
+      std::vector<post> items;
+      for (auto i = 0; i < n_publish; ++i)
+         items.push_back(make_bench_post(gen, size + i));
+
+      auto const t0 = steady_clock::now();
+      for (auto i = 0; i < n_publish; ++i) {
+         chn.remove_post(std::to_string(i), "", true);
+         chn.add_post(std::move(items[i]));
+      }
+
+      auto const t1 = steady_clock::now();
+      auto const us = duration_cast<microseconds>(t1 - t0).count();
+
+      std::cout << size
+                << '\t' << 1e6 * n_publish / us
+                << std::endl;
+
+      assert_equal(std::ssize(chn), long {size}, "publish_benchmark");
+   }
+}
+
+// Compares loading the posts key one message at a time, like
+// worker::apply_node_msg does, with the bulk loader.
+void load_benchmark()
+{
+   using namespace std::chrono;
+
+   std::mt19937 gen {1};
+   auto const threads = std::thread::hardware_concurrency();
+
+   std::cout << "posts\tone by one (ms)\tbulk (ms)\tsnapshot (ms)\tthreads" << std::endl;
+
+   for (auto size : {100000, 1000000}) {
+      std::vector<std::string> msgs;
+      for (auto i = 0; i < size; ++i) {
+         json j;
+         j["cmd"] = "publish_internal";
+         j["post"] = make_bench_post(gen, i);
+         msgs.push_back(j.dump());
+      }
+
+      auto const t0 = steady_clock::now();
+
+      channel a;
+      for (auto const& msg : msgs) {
+         auto const j = json::parse(msg);
+         a.add_post(j.at("post").get<post>());
+         a.remove_expired_posts(date_type {size}, date_type {size}, 1000);
+      }
+
+      auto const t1 = steady_clock::now();
+
+      channel b;
+      b.load(parse_posts(msgs, threads));
+
+      auto const t2 = steady_clock::now();
+
+      auto const path = "occase-db-tests.snapshot";
+      write_snapshot(path, b, date_type {0});
+
+      auto const t3 = steady_clock::now();
+
+      channel c;
+      c.load(read_snapshot(path).posts);
+      std::filesystem::remove(path);
+
+      auto const t4 = steady_clock::now();
+
+      std::cout << size
+                << '\t' << duration_cast<milliseconds>(t1 - t0).count()
+                << '\t' << duration_cast<milliseconds>(t2 - t1).count()
+                << '\t' << duration_cast<milliseconds>(t4 - t3).count()
+                << '\t' << threads
+                << std::endl;
+
+      assert_equal(std::ssize(a), std::ssize(b), "load_benchmark");
+      assert_equal(std::ssize(b), std::ssize(c), "load_benchmark");
+   }
+}
+
+// Compares scanning the candidates of a query on the posts, like the
+// channel did before the filter fields were stored by column, with
+// the columnar scan done by the channel.
+void scan_benchmark()
+{
+   using namespace std::chrono;
+
+   auto constexpr size = 1000000;
+   auto constexpr repeat = 20;
+
+   std::mt19937 gen {1};
+   std::uniform_int_distribution<int> dist {0, 999};
+
+   std::vector<post> posts;
+   channel chn;
+   for (auto i = 0; i < size; ++i) {
+      auto p = make_bench_post(gen, i);
+      p.description = std::string(100, 'a');
+      p.range_values = {dist(gen), 2000 + dist(gen) % 20};
+      posts.push_back(p);
+      chn.add_post(std::move(p));
+   }
+
+   // Selects about 10% of the posts by location and checks their
+   // product and range. The range is too wide to be used as index.
+   post q;
+   q.location = {3};
+   q.product = {5, 1};
+   q.range_values = {0, 499, 2005, 2015};
+
+   std::vector<slot_type> candidates;
+   for (auto i = 0; i < size; ++i) {
+      if (posts[i].location.front() == 3)
+         candidates.push_back(i);
+   }
+
+   auto is_child_of = [](auto const& code, auto const& prefix)
+   {
+      return std::size(prefix) <= std::size(code)
+          && std::equal(std::cbegin(prefix), std::cend(prefix), std::cbegin(code));
+   };
+
+   auto in_ranges = [&](auto const& values)
+   {
+      for (auto i = 0U; i + 1 < std::size(q.range_values); i += 2) {
+         auto const dim = i / 2;
+         if (dim >= std::size(values) || values[dim] < q.range_values[i] || values[dim] > q.range_values[i + 1])
+            return false;
+      }
+
+      return true;
+   };
+
+   auto const t0 = steady_clock::now();
+
+   int rows = 0;
+   for (auto i = 0; i < repeat; ++i) {
+      for (auto slot : candidates) {
+         auto const& p = posts[slot];
+         if (is_child_of(p.location, q.location) && is_child_of(p.product, q.product) && in_ranges(p.range_values))
+            ++rows;
+      }
+   }
+
+   auto const t1 = steady_clock::now();
+
+   int columns = 0;
+   for (auto i = 0; i < repeat; ++i)
+      columns += chn.count(q);
+
+   auto const t2 = steady_clock::now();
+
+   // The bytes read per post by each scan.
+   auto const& p = posts.front();
+   auto const row_bytes = sizeof (post)
+      + sizeof (int) * (std::size(p.location) + std::size(p.product) + std::size(p.range_values));
+
+   auto const column_bytes = 2 * sizeof (packed_code)
+      + sizeof (std::uint32_t)
+      + sizeof (int) * std::size(p.range_values);
+
+   auto const scanned = double(std::size(candidates)) * repeat;
+   auto const row_s = duration_cast<duration<double>>(t1 - t0).count();
+   auto const column_s = duration_cast<duration<double>>(t2 - t1).count();
+
+   std::cout << "layout\tscan (posts/s)\tbytes/post" << std::endl;
+   std::cout << "rows\t" << scanned / row_s << '\t' << row_bytes << std::endl;
+   std::cout << "columns\t" << scanned / column_s << '\t' << column_bytes << std::endl;
+
+   assert_equal(rows, columns, "scan_benchmark");
+}
+
+// Reports the heap memory per post taken by the post records and by
+// the whole channel.
+void memory_benchmark()
+{
+   auto constexpr size = 100000;
+
+   auto heap = []
+      { return double(mallinfo2().uordblks); };
+
+   std::mt19937 gen {1};
+   std::vector<post> items;
+   for (auto i = 0; i < size; ++i)
+      items.push_back(make_full_post(gen, i));
+
+   auto const h0 = heap();
+   std::vector<post> rows {items};
+   auto const h1 = heap();
+
+   image_hosts hosts;
+   intern_table strings;
+   std::vector<compact_post> compact;
+   compact.reserve(size);
+   for (auto const& p : items)
+      compact.push_back({p, hosts, strings});
+
+   auto const h2 = heap();
+
+   channel chn;
+   for (auto const& p : items)
+      chn.add_post(p);
+
+   auto const h3 = heap();
+
+   std::cout << "record\tbytes/post" << std::endl;
+   std::cout << "post\t" << (h1 - h0) / size << std::endl;
+   std::cout << "compact\t" << (h2 - h1) / size << std::endl;
+   std::cout << "channel\t" << (h3 - h2) / size << std::endl;
+
+   assert_equal(std::ssize(chn), long {size}, "memory_benchmark");
+}
+
+// Compares the cpu time of serializing the search results as before,
+// i.e. building a json document from the posts, with writing them
+// from their compact encoding.
+void search_json_benchmark()
+{
+   using namespace std::chrono;
+
+   auto constexpr size = 100000;
+   auto constexpr n_queries = 200;
+
+   std::mt19937 gen {1};
+   channel chn;
+   for (auto i = 0; i < size; ++i)
+      chn.add_post(make_full_post(gen, i));
+
+   std::size_t n = 0;
+   std::size_t bytes = 0;
+
+   auto const t0 = steady_clock::now();
+   for (auto i = 0; i < n_queries; ++i) {
+      post q;
+      q.location = {i % 10};
+      std::string cursor;
+      json j;
+      j["posts"] = chn.query(q, 300, cursor, channel::order_by::date);
+      n += std::size(j["posts"]);
+      bytes += std::size(j.dump());
+   }
+
+   auto const t1 = steady_clock::now();
+   for (auto i = 0; i < n_queries; ++i) {
+      post q;
+      q.location = {i % 10};
+      std::string cursor;
+      std::string s = "{\"posts\":";
+      chn.query_json(q, 300, cursor, channel::order_by::date, s);
+      s += "}";
+      bytes -= std::size(s);
+   }
+
+   auto const t2 = steady_clock::now();
+
+   auto const before = duration_cast<nanoseconds>(t1 - t0).count();
+   auto const after = duration_cast<nanoseconds>(t2 - t1).count();
+
+   std::cout << "serialization\tus/post" << std::endl;
+   std::cout << "json\t" << before / 1e3 / n << std::endl;
+   std::cout << "compact\t" << after / 1e3 / n << std::endl;
+
+   assert_true(bytes == 0, "search_json_benchmark");
+}
+
+// Compares parsing and dispatching app messages through a json
+// document, as before, with app_msg. Both read the fields the worker
+// needs for each command.
+void app_msg_benchmark()
+{
+   using namespace std::chrono;
+
+   auto constexpr n_msgs = 400000;
+
+   std::mt19937 gen {1};
+   auto const hash = make_hex_digest("user");
+
+   json login;
+   login["cmd"] = "login";
+   login["user"] = "abcdefgh";
+   login["key"] = "0123456789abcdef";
+   login["token"] = std::string(150, 'x');
+
+   json chat;
+   chat["cmd"] = "message";
+   chat["type"] = "chat";
+   chat["to"] = hash;
+   chat["post_id"] = "abcdefgh";
+   chat["id"] = 12;
+   chat["refers_to"] = -1;
+   chat["nick"] = "Someone";
+   chat["message"] = "Hello, is it still available? I could pick it up tomorrow.";
+
+   json presence;
+   presence["cmd"] = "presence";
+   presence["to"] = hash;
+   presence["type"] = "writing";
+
+   json publish;
+   publish["cmd"] = "publish";
+   publish["user"] = "abcdefgh";
+   publish["key"] = "0123456789abcdef";
+   publish["post"] = make_full_post(gen, 0);
+
+   // Chat messages are by far the most common.
+   std::vector<std::string> msgs;
+   for (auto const* j : {&login, &chat, &chat, &chat, &chat, &chat, &chat, &presence, &presence, &publish})
+      msgs.push_back(j->dump());
+
+   std::size_t sum = 0;
+
+   auto const t0 = steady_clock::now();
+   for (auto i = 0; i < n_msgs; ++i) {
+      auto const j = json::parse(msgs[i % std::size(msgs)]);
+      auto const cmd = j.at("cmd").get<std::string>();
+      if (cmd == "presence") {
+         sum += std::size(j.at("to").get<std::string>());
+      } else if (cmd == "message") {
+         sum += std::size(j.at("to").get<std::string>());
+         sum += std::size(j.at("post_id").get<std::string>());
+         sum += j.at("id").get<int>();
+      } else if (cmd == "publish") {
+         sum += std::size(j.at("user").get<std::string>());
+         sum += std::size(j.at("key").get<std::string>());
+      } else if (cmd == "login") {
+         sum += std::size(j.at("user").get<std::string>());
+         sum += std::size(j.at("key").get<std::string>());
+         sum += std::size(j.at("token").get<std::string>());
+      }
+   }
+
+   auto const t1 = steady_clock::now();
+
+   app_msg m;
+   for (auto i = 0; i < n_msgs; ++i) {
+      m.parse(msgs[i % std::size(msgs)]);
+      switch (m.cmd()) {
+         case app_cmd::presence:
+            sum -= std::size(m.get_string("to"));
+            break;
+         case app_cmd::message:
+         {
+            sum -= std::size(m.get_string("to"));
+            sum -= std::size(m.get_string("post_id"));
+            sum -= m.get_int("id");
+         } break;
+         case app_cmd::publish:
+         {
+            sum -= std::size(m.get_string("user"));
+            sum -= std::size(m.get_string("key"));
+         } break;
+         case app_cmd::login:
+         {
+            sum -= std::size(m.get_string("user"));
+            sum -= std::size(m.get_string("key"));
+            sum -= std::size(m.get_string("token"));
+         } break;
+         default:
+            break;
+      }
+   }
+
+   auto const t2 = steady_clock::now();
+
+   auto rate = [](auto d)
+      { return n_msgs / duration_cast<duration<double>>(d).count(); };
+
+   std::cout << "parser\tmsgs/s" << std::endl;
+   std::cout << "json\t" << rate(t1 - t0) << std::endl;
+   std::cout << "app_msg\t" << rate(t2 - t1) << std::endl;
+
+   assert_true(sum == 0, "app_msg_benchmark");
+}
+
+void node_msg_benchmark()
+{
+   using namespace std::chrono;
+
+   auto constexpr n_msgs = 200000;
+
+   std::mt19937 gen {1};
+
+   std::vector<node_msg> msgs;
+   for (auto i = 0; i < 100; ++i) {
+      node_msg m;
+      m.cmd = node_msg::kind::publish;
+      m.item = make_full_post(gen, i);
+      msgs.push_back(std::move(m));
+   }
+
+   std::vector<std::string> texts;
+   std::vector<std::string> envelopes;
+   std::size_t text_bytes = 0;
+   std::size_t envelope_bytes = 0;
+   for (auto const& m : msgs) {
+      texts.push_back(serialize(m, false));
+      envelopes.push_back(serialize(m, true));
+      text_bytes += std::size(texts.back());
+      envelope_bytes += std::size(envelopes.back());
+   }
+
+   std::size_t sum = 0;
+
+   auto const t0 = steady_clock::now();
+   for (auto i = 0; i < n_msgs; ++i)
+      sum += std::size(parse_node_msg(texts[i % std::size(texts)]).item.id);
+
+   auto const t1 = steady_clock::now();
+   for (auto i = 0; i < n_msgs; ++i)
+      sum -= std::size(parse_node_msg(envelopes[i % std::size(envelopes)]).item.id);
+
+   auto const t2 = steady_clock::now();
+
+   auto rate = [](auto d)
+      { return n_msgs / duration_cast<duration<double>>(d).count(); };
+
+   std::cout << "format	bytes/msg	msgs/s" << std::endl;
+   std::cout << "json	" << text_bytes / std::size(msgs) << "\t\t" << rate(t1 - t0) << std::endl;
+   std::cout << "binary	" << envelope_bytes / std::size(msgs) << "\t\t" << rate(t2 - t1) << std::endl;
+
+   assert_true(sum == 0, "node_msg_benchmark");
+}
+
 int main(int argc, char* argv[])
 {
    options op;
@@ -691,6 +2660,15 @@ int main(int argc, char* argv[])
      "• 4:  \tno_login.\n"
      "• 6:  \toffline messages.\n"
      "• 7:  \tunittests.\n"
+     "• 8:  \tchannel benchmark.\n"
+     "• 9:  \tkernels benchmark.\n"
+     "• 10: \tpublish benchmark.\n"
+     "• 11: \tload benchmark.\n"
+     "• 12: \tscan benchmark.\n"
+     "• 13: \tmemory benchmark.\n"
+     "• 14: \tsearch json benchmark.\n"
+     "• 15: \tapp message parser benchmark.\n"
+     "• 16: \tposts channel message benchmark.\n"
    )
    ;
 
@@ -733,6 +2711,54 @@ int main(int argc, char* argv[])
 
    if (op.test == 7) {
       channel_tests();
+      bitmap_tests();
+      slot_list_tests();
+      compact_post_tests();
+      intern_tests();
+      query_json_tests();
+      query_cache_tests();
+      app_msg_tests();
+      app_codec_tests();
+      responses_tests();
+      node_msg_tests();
+      snapshot_tests();
+      kernels_tests();
+   }
+
+   if (op.test == 8) {
+      channel_benchmark();
+   }
+
+   if (op.test == 9) {
+      kernels_benchmark();
+   }
+
+   if (op.test == 10) {
+      publish_benchmark();
+   }
+
+   if (op.test == 11) {
+      load_benchmark();
+   }
+
+   if (op.test == 12) {
+      scan_benchmark();
+   }
+
+   if (op.test == 13) {
+      memory_benchmark();
+   }
+
+   if (op.test == 14) {
+      search_json_benchmark();
+   }
+
+   if (op.test == 15) {
+      app_msg_benchmark();
+   }
+
+   if (op.test == 16) {
+      node_msg_benchmark();
    }
 
    ioc.run();
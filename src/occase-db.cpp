@@ -33,6 +33,7 @@ struct config_all {
    int idle_timeout;
    int post_interval;
    int post_expiration;
+   int post_expiration_interval;
 
    auto get_timeouts() const noexcept
    {
@@ -41,6 +42,7 @@ struct config_all {
       , std::chrono::seconds {idle_timeout}
       , std::chrono::seconds {post_interval}
       , std::chrono::seconds {post_expiration}
+      , std::chrono::seconds {post_expiration_interval}
       };
    }
 
@@ -76,6 +78,11 @@ auto get_cfg(int argc, char* argv[])
    ("handshake-timeout", po::value<int>(&cfg.handshake_timeout)->default_value(2))
    ("idle-timeout", po::value<int>(&cfg.idle_timeout)->default_value(30))
    ("post-expiration", po::value<int>(&cfg.post_expiration)->default_value(3 * 30 * 24 * 60 * 60))
+   ("post-expiration-interval", po::value<int>(&cfg.post_expiration_interval)->default_value(60))
+   ("post-expiration-batch", po::value<int>(&cfg.core.post_expiration_batch)->default_value(1000))
+   ("snapshot-file", po::value<std::string>(&cfg.core.snapshot_file))
+   ("snapshot-interval", po::value<int>(&cfg.core.snapshot_interval)->default_value(300))
+   ("search-cache-size", po::value<int>(&cfg.core.search_cache_size)->default_value(1000))
    ("log-level", po::value<std::string>(&logfilter_str)->default_value("notice"))
    ("max-posts-on-search", po::value<int>(&cfg.core.max_posts_on_search)->default_value(300))
    ("post-interval", po::value<int>(&cfg.post_interval)->default_value(7 * 24 * 60 * 60))
@@ -100,6 +107,9 @@ auto get_cfg(int argc, char* argv[])
    ("redis-notify-channel", po::value<std::string>(&cfg.core.redis.notify_channel)->default_value("notify"))
    ("redis-tokens-key", po::value<std::string>(&cfg.core.redis.tokens_key)->default_value("fcm_tokens"))
    ("redis-post-visualizations-key", po::value<std::string>(&cfg.core.redis.post_visualizations_key)->default_value("post_visualizations"))
+   ("redis-posts-log-key", po::value<std::string>(&cfg.core.redis.posts_log_key)->default_value("posts_log"))
+   ("redis-posts-log-size", po::value<int>(&cfg.core.redis.posts_log_size)->default_value(100000))
+   ("redis-posts-channel-binary", po::value<bool>(&cfg.core.redis.posts_channel_binary)->default_value(false))
    ;
 
    po::positional_options_description pos;
@@ -1,5 +1,9 @@
 #include "post.hpp"
 
+#include <thread>
+#include <algorithm>
+#include <system_error>
+
 #include <nlohmann/json.hpp>
 
 namespace occase
@@ -50,6 +54,64 @@ void from_json(json const& j, post& e)
   std::for_each(std::begin(e.images), std::end(e.images), f);
 }
 
+std::vector<post>
+parse_posts(std::vector<std::string> const& msgs, int n_threads)
+{
+   auto const n = std::size(msgs);
+
+   std::vector<post> posts(n);
+   std::vector<char> valid(n, 0);
+
+   // Each thread writes to its own range of posts and valid.
+   auto f = [&](std::size_t begin, std::size_t end)
+   {
+      for (auto i = begin; i < end; ++i) {
+         try {
+            auto const j = json::parse(msgs[i]);
+            if (j.at("cmd").get<std::string>() != "publish_internal")
+               continue;
+
+            posts[i] = j.at("post").get<post>();
+            valid[i] = 1;
+         } catch (std::exception const&) {
+         }
+      }
+   };
+
+   std::size_t const threads = std::max(n_threads, 1);
+   auto const step = (n + threads - 1) / threads;
+
+   // When a thread can't be started the remaining chunks are parsed
+   // on this thread, so that the caller never sees the error.
+   std::size_t next = 1;
+   std::vector<std::thread> pool;
+   try {
+      for (; next < threads && next * step < n; ++next)
+         pool.emplace_back(f, next * step, std::min(n, (next + 1) * step));
+   } catch (std::system_error const&) {
+   }
+
+   f(0, std::min(n, step));
+   f(std::min(n, next * step), n);
+
+   for (auto& t : pool)
+      t.join();
+
+   std::size_t j = 0;
+   for (auto i = 0U; i < n; ++i) {
+      if (!valid[i])
+         continue;
+
+      if (i != j)
+         posts[j] = std::move(posts[i]);
+
+      ++j;
+   }
+
+   posts.resize(j);
+   return posts;
+}
+
 std::string make_dir(std::string const& filename)
 {
    assert(std::size(filename) >= sz::mms_filename_size);
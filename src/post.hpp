@@ -59,7 +59,7 @@ using date_type = std::chrono::seconds;
 
 struct post {
    date_type date {0};
-   int visualizations;
+   int visualizations {0};
    std::string id;
    std::string from;
    std::string nick;
@@ -91,6 +91,12 @@ struct comp_post_id_equal {
 void to_json(json& j, post const& e);
 void from_json(json const& j, post& e);
 
+// Parses the values of the posts key in redis, i.e. publish_internal
+// messages, splitting the work among n_threads threads. Invalid
+// messages are skipped.
+std::vector<post>
+parse_posts(std::vector<std::string> const& msgs, int n_threads);
+
 template <class T>
 T get_optional_field(json const& j, std::string const& v)
 {
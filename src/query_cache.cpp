@@ -0,0 +1,117 @@
+#include "query_cache.hpp"
+
+#include <iterator>
+
+namespace occase
+{
+
+namespace
+{
+
+template <class T>
+void append(std::string& out, std::vector<T> const& v, std::size_t n)
+{
+   for (auto i = 0U; i < n; ++i) {
+      out += std::to_string(v[i]);
+      out += ',';
+   }
+
+   out += '|';
+}
+
+} // anonymous
+
+std::string canonical_query(post const& q)
+{
+   std::string ret;
+   append(ret, q.location, std::size(q.location));
+   append(ret, q.product, std::size(q.product));
+
+   // Negative values match any value.
+   std::vector<int> details;
+   for (auto e : q.ex_details)
+      details.push_back(e < 0 ? -1 : e);
+
+   while (!std::empty(details) && details.back() < 0)
+      details.pop_back();
+
+   append(ret, details, std::size(details));
+
+   // Zero masks match any value.
+   auto n = std::size(q.in_details);
+   while (n != 0 && q.in_details[n - 1] == 0)
+      --n;
+
+   append(ret, q.in_details, n);
+
+   // Pairs with min > max match any value and an incomplete pair is
+   // ignored.
+   std::vector<int> ranges;
+   for (auto i = 0U; i + 1 < std::size(q.range_values); i += 2) {
+      auto const min = q.range_values[i];
+      auto const max = q.range_values[i + 1];
+      ranges.push_back(min > max ? 1 : min);
+      ranges.push_back(min > max ? 0 : max);
+   }
+
+   while (!std::empty(ranges) && ranges[std::size(ranges) - 2] > ranges.back()) {
+      ranges.pop_back();
+      ranges.pop_back();
+   }
+
+   append(ret, ranges, std::size(ranges));
+   return ret;
+}
+
+query_cache::query_cache(std::size_t max_size)
+: max_size_ {max_size}
+{ }
+
+void query_cache::erase(std::list<entry>::iterator iter)
+{
+   index_.erase(iter->key);
+   entries_.erase(iter);
+}
+
+std::string const*
+query_cache::find(std::string const& key, std::uint64_t generation)
+{
+   auto const match = index_.find(key);
+   if (match == std::end(index_)) {
+      ++misses_;
+      return nullptr;
+   }
+
+   auto const iter = match->second;
+   if (iter->generation < generation) {
+      erase(iter);
+      ++misses_;
+      return nullptr;
+   }
+
+   entries_.splice(std::begin(entries_), entries_, iter);
+   ++hits_;
+   return &iter->value;
+}
+
+void
+query_cache::insert(
+   std::string key,
+   std::uint64_t generation,
+   std::string value)
+{
+   if (max_size_ == 0)
+      return;
+
+   auto const match = index_.find(key);
+   if (match != std::end(index_))
+      erase(match->second);
+
+   entries_.push_front({std::move(key), generation, std::move(value)});
+   index_.insert({entries_.front().key, std::begin(entries_)});
+
+   if (std::size(entries_) > max_size_)
+      erase(std::prev(std::end(entries_)));
+}
+
+} // occase
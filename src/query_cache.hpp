@@ -0,0 +1,61 @@
+#pragma once
+
+#include <list>
+#include <string>
+#include <cstdint>
+#include <string_view>
+#include <unordered_map>
+
+#include "post.hpp"
+
+namespace occase {
+
+// Returns a key that is equal for queries that select the same posts,
+// i.e. ignoring the trailing fields that match any value, see
+// channel::query.
+std::string canonical_query(post const& q);
+
+// LRU cache of serialized query responses. Each entry holds the
+// channel generation at which it was computed and is only returned
+// while the generation of the query is not greater, see
+// channel::generation. Posts added to or removed from other location
+// and product subtrees don't invalidate it.
+class query_cache {
+private:
+   struct entry {
+      std::string key;
+      std::uint64_t generation;
+      std::string value;
+   };
+
+   // Most recently used first.
+   std::list<entry> entries_;
+
+   // The keys refer to the strings in entries_.
+   std::unordered_map<std::string_view, std::list<entry>::iterator> index_;
+
+   std::size_t max_size_;
+   std::uint64_t hits_ = 0;
+   std::uint64_t misses_ = 0;
+
+   void erase(std::list<entry>::iterator iter);
+
+public:
+   // A cache with max_size zero stores nothing.
+   explicit query_cache(std::size_t max_size = 0);
+
+   // Returns the value stored for key if it was computed at a
+   // generation not less than generation, nullptr otherwise. Stale
+   // entries are released.
+   std::string const* find(std::string const& key, std::uint64_t generation);
+
+   // Stores the value computed at the given generation, evicting the
+   // least recently used entry when the cache is full.
+   void insert(std::string key, std::uint64_t generation, std::string value);
+
+   auto size() const noexcept { return std::size(entries_); }
+   auto hits() const noexcept { return hits_; }
+   auto misses() const noexcept { return misses_; }
+};
+
+} // occase
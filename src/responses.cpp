@@ -0,0 +1,91 @@
+#include "responses.hpp"
+
+#include "app_msg.hpp"
+
+namespace occase
+{
+
+void write_login_ack(std::string& out, bool ok)
+{
+   out += ok ? R"({"cmd":"login_ack","result":"ok"})"
+             : R"({"cmd":"login_ack","result":"fail"})";
+}
+
+void
+write_server_ack(
+   std::string& out,
+   std::string_view from,
+   std::string_view to,
+   std::string_view post_id,
+   int ack_id)
+{
+   out.reserve(std::size(out) + std::size(from) + std::size(to) + std::size(post_id) + 128);
+   out += R"({"ack_id":)";
+   out += std::to_string(ack_id);
+   out += R"(,"cmd":"message","from":)";
+   append_json_string(out, from);
+   out += R"(,"post_id":)";
+   append_json_string(out, post_id);
+   out += R"(,"result":"ok","to":)";
+   append_json_string(out, to);
+   out += R"(,"type":"server_ack"})";
+}
+
+void
+write_publish_ack(
+   std::string& out,
+   std::string_view id,
+   long date,
+   std::string_view admin_id)
+{
+   out += R"({"admin_id":)";
+   append_json_string(out, admin_id);
+   out += R"(,"cmd":"publish_ack","date":)";
+   out += std::to_string(date);
+   out += R"(,"id":)";
+   append_json_string(out, id);
+   out += R"(,"result":"ok"})";
+}
+
+void write_publish_fail(std::string& out, std::string_view reason)
+{
+   out += R"({"cmd":"publish_ack","reason":)";
+   append_json_string(out, reason);
+   out += R"(,"result":"fail"})";
+}
+
+void
+write_user_id(
+   std::string& out,
+   std::string_view user,
+   std::string_view key,
+   std::string_view user_id)
+{
+   out += R"({"key":)";
+   append_json_string(out, key);
+   out += R"(,"result":"ok","user":)";
+   append_json_string(out, user);
+   out += R"(,"user_id":)";
+   append_json_string(out, user_id);
+   out += "}";
+}
+
+void
+write_search_response(
+   std::string& out,
+   std::string_view cursor,
+   std::string_view posts)
+{
+   out += "{";
+   if (!std::empty(cursor)) {
+      out += R"("cursor":)";
+      append_json_string(out, cursor);
+      out += ",";
+   }
+
+   out += R"("posts":)";
+   out += posts;
+   out += "}";
+}
+
+} // occase
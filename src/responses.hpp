@@ -0,0 +1,51 @@
+#pragma once
+
+#include <string>
+#include <string_view>
+
+namespace occase {
+
+// Serializers of the messages the server sends to the apps. They
+// append to out the same bytes as building the message as a json
+// object and calling dump, i.e. with the keys in ascending order, but
+// without the intermediate document. Like dump they throw on strings
+// that are not valid UTF-8.
+
+// {"cmd":"login_ack","result":"ok"} or "fail".
+void write_login_ack(std::string& out, bool ok);
+
+// The acknowledgement of a chat message, see
+// worker::on_app_chat_msg.
+void
+write_server_ack(
+   std::string& out,
+   std::string_view from,
+   std::string_view to,
+   std::string_view post_id,
+   int ack_id);
+
+void
+write_publish_ack(
+   std::string& out,
+   std::string_view id,
+   long date,
+   std::string_view admin_id);
+
+void write_publish_fail(std::string& out, std::string_view reason);
+
+// The response to /get-user-id.
+void
+write_user_id(
+   std::string& out,
+   std::string_view user,
+   std::string_view key,
+   std::string_view user_id);
+
+// The response to /posts/search, where posts is a json array.
+void
+write_search_response(
+   std::string& out,
+   std::string_view cursor,
+   std::string_view posts);
+
+} // occase
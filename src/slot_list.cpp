@@ -0,0 +1,90 @@
+#include "slot_list.hpp"
+
+#include <iterator>
+#include <algorithm>
+
+namespace occase
+{
+
+std::size_t slot_list::find_chunk(slot_type v) const noexcept
+{
+   auto comp = [](auto const& c, auto v)
+      { return c.back() < v; };
+
+   auto const point =
+      std::lower_bound(std::cbegin(chunks_), std::cend(chunks_), v, comp);
+
+   if (point == std::cend(chunks_) && !std::empty(chunks_))
+      return std::size(chunks_) - 1;
+
+   return point - std::cbegin(chunks_);
+}
+
+bool slot_list::insert(slot_type v)
+{
+   if (std::empty(chunks_)) {
+      chunks_.push_back({v});
+      ++size_;
+      return true;
+   }
+
+   auto const i = find_chunk(v);
+   auto& c = chunks_[i];
+
+   // New posts usually get the highest slot.
+   if (c.back() < v) {
+      c.push_back(v);
+   } else {
+      auto const point = std::lower_bound(std::begin(c), std::end(c), v);
+      if (*point == v)
+         return false;
+
+      c.insert(point, v);
+   }
+
+   ++size_;
+
+   if (std::size(c) > chunk_max) {
+      auto const half = std::begin(c) + std::size(c) / 2;
+      std::vector<slot_type> upper(half, std::end(c));
+      c.erase(half, std::end(c));
+      chunks_.insert(std::begin(chunks_) + i + 1, std::move(upper));
+   }
+
+   return true;
+}
+
+bool slot_list::erase(slot_type v)
+{
+   if (std::empty(chunks_))
+      return false;
+
+   auto const i = find_chunk(v);
+   auto& c = chunks_[i];
+
+   auto const point = std::lower_bound(std::begin(c), std::end(c), v);
+   if (point == std::end(c) || *point != v)
+      return false;
+
+   c.erase(point);
+   --size_;
+
+   if (std::empty(c)) {
+      chunks_.erase(std::begin(chunks_) + i);
+      return true;
+   }
+
+   // Merges small neighbours so that the number of chunks stays
+   // proportional to the size.
+   if (i + 1 < std::size(chunks_)) {
+      auto& next = chunks_[i + 1];
+      if (std::size(c) + std::size(next) <= chunk_max / 2) {
+         c.insert(std::end(c), std::cbegin(next), std::cend(next));
+         chunks_.erase(std::begin(chunks_) + i + 1);
+      }
+   }
+
+   return true;
+}
+
+} // occase
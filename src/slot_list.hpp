@@ -0,0 +1,69 @@
+#pragma once
+
+#include <vector>
+#include <cstdint>
+#include <algorithm>
+
+namespace occase {
+
+// The position of a post inside the channel storage. It does not
+// change while the post is alive.
+using slot_type = std::uint32_t;
+
+// Sorted list of slots stored in chunks of bounded size, like the
+// leaves of a B+-tree. Insertion and removal binary search the chunk
+// and shift only its elements, instead of the whole list, which
+// matters for lists holding all posts of the channel.
+class slot_list {
+private:
+   // Chunks are split in halves above this size.
+   static constexpr std::size_t chunk_max = 1024;
+
+   // Sorted, non-empty and disjoint.
+   std::vector<std::vector<slot_type>> chunks_;
+   std::size_t size_ = 0;
+
+   // Returns the index of the first chunk whose last element is not
+   // less than v or the last chunk if there is none.
+   std::size_t find_chunk(slot_type v) const noexcept;
+
+public:
+   // Adds v to the list. Returns false if it is already present.
+   bool insert(slot_type v);
+
+   // Removes v from the list. Returns false if it is not present.
+   bool erase(slot_type v);
+
+   auto size() const noexcept { return size_; }
+   auto empty() const noexcept { return size_ == 0; }
+
+   // Calls f(begin, end) with the contiguous ranges of elements not
+   // less than from, in ascending order, until f returns false.
+   template <class F>
+   void for_each_range(slot_type from, F f) const
+   {
+      auto const first = find_chunk(from);
+      for (auto i = first; i < std::size(chunks_); ++i) {
+         auto const* begin = chunks_[i].data();
+         auto const* end = begin + std::size(chunks_[i]);
+
+         // Only the first chunk may have elements less than from.
+         if (i == first)
+            begin = std::lower_bound(begin, end, from);
+
+         if (begin != end && !f(begin, end))
+            return;
+      }
+   }
+
+   // Calls f on each element in ascending order.
+   template <class F>
+   void for_each(F f) const
+   {
+      for (auto const& c : chunks_)
+         for (auto v : c)
+            f(v);
+   }
+};
+
+} // occase
@@ -0,0 +1,283 @@
+#include "snapshot.hpp"
+
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <stdexcept>
+#include <filesystem>
+#include <type_traits>
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "channel.hpp"
+
+namespace occase
+{
+
+namespace
+{
+
+constexpr char magic[] = {'o', 'c', 's', 'n'};
+
+// Incremented on every change of the layout.
+constexpr std::uint32_t version = 1;
+
+class writer {
+private:
+   std::ofstream& ofs_;
+
+public:
+   writer(std::ofstream& ofs) : ofs_ {ofs} {}
+
+   template <class T>
+   std::enable_if_t<std::is_arithmetic_v<T>>
+   write(T v)
+      { ofs_.write(reinterpret_cast<char const*>(&v), sizeof v); }
+
+   void write(std::string const& s)
+   {
+      write(static_cast<std::uint32_t>(std::size(s)));
+      ofs_.write(s.data(), std::size(s));
+   }
+
+   template <class T>
+   void write(std::vector<T> const& v)
+   {
+      write(static_cast<std::uint32_t>(std::size(v)));
+      if constexpr (std::is_arithmetic_v<T>) {
+         ofs_.write(reinterpret_cast<char const*>(v.data()), sizeof (T) * std::size(v));
+      } else {
+         for (auto const& e : v)
+            write(e);
+      }
+   }
+
+   void write(post const& p)
+   {
+      write(static_cast<std::int64_t>(p.date.count()));
+      write(static_cast<std::int32_t>(p.visualizations));
+      write(p.id);
+      write(p.from);
+      write(p.nick);
+      write(p.avatar);
+      write(p.description);
+      write(p.location);
+      write(p.product);
+      write(p.ex_details);
+      write(p.in_details);
+      write(p.range_values);
+      write(p.images);
+   }
+};
+
+class reader {
+private:
+   char const* data_;
+   std::size_t size_;
+   std::size_t pos_ = 0;
+
+   void check(std::size_t n) const
+   {
+      if (size_ - pos_ < n)
+         throw std::runtime_error("Truncated snapshot.");
+   }
+
+public:
+   reader(char const* data, std::size_t size)
+   : data_ {data}
+   , size_ {size}
+   { }
+
+   template <class T>
+   std::enable_if_t<std::is_arithmetic_v<T>>
+   read(T& v)
+   {
+      check(sizeof v);
+      std::memcpy(&v, data_ + pos_, sizeof v);
+      pos_ += sizeof v;
+   }
+
+   void read(std::string& s)
+   {
+      std::uint32_t n;
+      read(n);
+      check(n);
+      s.assign(data_ + pos_, n);
+      pos_ += n;
+   }
+
+   template <class T>
+   void read(std::vector<T>& v)
+   {
+      std::uint32_t n;
+      read(n);
+      if constexpr (std::is_arithmetic_v<T>) {
+         check(sizeof (T) * n);
+         v.resize(n);
+         std::memcpy(v.data(), data_ + pos_, sizeof (T) * n);
+         pos_ += sizeof (T) * n;
+      } else {
+         // Every element takes at least one byte, this prevents huge
+         // allocations on corrupted files.
+         check(n);
+         v.resize(n);
+         for (auto& e : v)
+            read(e);
+      }
+   }
+
+   void read(post& p)
+   {
+      std::int64_t date;
+      read(date);
+      p.date = date_type {date};
+
+      std::int32_t visualizations;
+      read(visualizations);
+      p.visualizations = visualizations;
+
+      read(p.id);
+      read(p.from);
+      read(p.nick);
+      read(p.avatar);
+      read(p.description);
+      read(p.location);
+      read(p.product);
+      read(p.ex_details);
+      read(p.in_details);
+      read(p.range_values);
+      read(p.images);
+   }
+
+   void read_magic()
+   {
+      check(sizeof magic);
+      if (std::memcmp(data_, magic, sizeof magic) != 0)
+         throw std::runtime_error("Not a snapshot.");
+
+      pos_ += sizeof magic;
+   }
+};
+
+// Flushes the file or directory in path to the disk.
+void sync(std::string const& path, int flags)
+{
+   auto const fd = ::open(path.data(), flags);
+   if (fd == -1)
+      throw std::runtime_error("Unable to open " + path);
+
+   auto const ret = ::fsync(fd);
+   ::close(fd);
+
+   if (ret == -1)
+      throw std::runtime_error("Unable to sync " + path);
+}
+
+} // anonymous
+
+void
+write_snapshot(
+   std::string const& path,
+   channel const& chn,
+   date_type time)
+{
+   auto const tmp = path + ".tmp";
+
+   {
+      std::ofstream ofs {tmp, std::ios::binary | std::ios::trunc};
+      if (!ofs)
+         throw std::runtime_error("Unable to open " + tmp);
+
+      writer w {ofs};
+      ofs.write(magic, sizeof magic);
+      w.write(version);
+      w.write(static_cast<std::int64_t>(time.count()));
+      w.write(static_cast<std::uint64_t>(chn.size()));
+
+      auto f = [&](auto const& p)
+         { w.write(p); };
+
+      chn.for_each(f);
+
+      ofs.flush();
+      if (!ofs)
+         throw std::runtime_error("Unable to write " + tmp);
+   }
+
+   // Otherwise the rename may reach the disk before the data and a
+   // crash would leave an empty or partial snapshot.
+   sync(tmp, O_WRONLY);
+
+   if (std::rename(tmp.data(), path.data()) != 0)
+      throw std::runtime_error("Unable to rename " + tmp);
+
+   // Makes the rename itself durable.
+   auto dir = std::filesystem::path {path}.parent_path().string();
+   if (std::empty(dir))
+      dir = ".";
+
+   sync(dir, O_RDONLY | O_DIRECTORY);
+}
+
+snapshot read_snapshot(std::string const& path)
+{
+   auto const fd = ::open(path.data(), O_RDONLY);
+   if (fd == -1)
+      throw std::runtime_error("Unable to open " + path);
+
+   struct stat st;
+   if (::fstat(fd, &st) == -1 || st.st_size == 0) {
+      ::close(fd);
+      throw std::runtime_error("Unable to stat " + path);
+   }
+
+   std::size_t const size = st.st_size;
+   auto* addr = ::mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+   ::close(fd);
+
+   if (addr == MAP_FAILED)
+      throw std::runtime_error("Unable to map " + path);
+
+   // The whole file is read sequentially once.
+   ::madvise(addr, size, MADV_SEQUENTIAL);
+
+   snapshot ret;
+
+   try {
+      reader r {static_cast<char const*>(addr), size};
+      r.read_magic();
+
+      std::uint32_t v;
+      r.read(v);
+      if (v != version)
+         throw std::runtime_error("Unsupported snapshot version.");
+
+      std::int64_t time;
+      r.read(time);
+      ret.time = date_type {time};
+
+      std::uint64_t n;
+      r.read(n);
+
+      // Each post takes at least a few bytes, this prevents huge
+      // allocations on corrupted files.
+      if (n > size)
+         throw std::runtime_error("Corrupted snapshot.");
+
+      ret.posts.resize(n);
+      for (auto& p : ret.posts)
+         r.read(p);
+
+   } catch (...) {
+      ::munmap(addr, size);
+      throw;
+   }
+
+   ::munmap(addr, size);
+   return ret;
+}
+
+} // occase
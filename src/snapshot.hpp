@@ -0,0 +1,42 @@
+#pragma once
+
+#include <string>
+#include <vector>
+
+#include "post.hpp"
+
+namespace occase {
+
+class channel;
+
+// Binary image of the posts of a channel, used to restart without
+// reading all posts from redis. The file layout is
+//
+//    header: magic, version, time, number of posts
+//    posts:  date, visualizations, strings and vectors
+//
+// where integers are stored in the host byte order, strings and
+// vectors are prefixed by their 32-bit size. The file is read through
+// mmap.
+struct snapshot {
+   // The time the snapshot was written.
+   date_type time {0};
+
+   // Sorted by date.
+   std::vector<post> posts;
+};
+
+// Writes the posts of the channel to path. The file is written to a
+// temporary file, synced and then renamed so that a crash never
+// leaves a partial snapshot behind. Throws on error.
+void
+write_snapshot(
+   std::string const& path,
+   channel const& chn,
+   date_type time);
+
+// Reads the snapshot in path. Throws if the file does not exist or is
+// not a valid snapshot.
+snapshot read_snapshot(std::string const& path);
+
+} // occase
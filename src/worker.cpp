@@ -1,10 +1,13 @@
 #include "worker.hpp"
+#include "responses.hpp"
 
+#include <thread>
 #include <iostream>
 #include <numeric>
 #include <iterator>
 #include <algorithm>
 #include <functional>
+#include <unordered_set>
 
 #include <fmt/format.h>
 
@@ -25,7 +28,13 @@ std::ostream& operator<<(std::ostream& os, worker_stats const& stats)
       << '\t'
       << stats.db_post_queue_size
       << '\t'
-      << stats.db_chat_queue_size;
+      << stats.db_chat_queue_size
+      << '\t'
+      << stats.search_cache_hits
+      << '\t'
+      << stats.search_cache_misses
+      << '\t'
+      << stats.search_cache_size;
 
    return os;
 }
@@ -45,8 +54,11 @@ void worker::init()
 worker::worker(config::core cfg, ssl::context& c)
 : ctx_ {c}
 , cfg_ {cfg}
+, search_cache_ {static_cast<std::size_t>(std::max(cfg.search_cache_size, 0))}
 , acceptor_ {ioc_}
 , signal_set_ {ioc_, SIGINT, SIGTERM}
+, expiration_timer_ {ioc_}
+, snapshot_timer_ {ioc_}
 {
    redis_conn_ =
       std::make_shared<aedis::connection>(
@@ -59,6 +71,13 @@ worker::worker(config::core cfg, ssl::context& c)
    signal_set_.async_wait(f);
 
    net::post(ioc_, [this]{ init(); });
+
+   start_expiration_timer(cfg_.timeouts.post_expiration_interval);
+
+   if (!std::empty(cfg_.snapshot_file)) {
+      load_snapshot();
+      start_snapshot_timer();
+   }
 }
 
 void worker::on_quit(aedis::resp::simple_string_type& s) noexcept
@@ -75,21 +94,204 @@ void worker::on_hello(aedis::resp::map_type& v) noexcept
    // 2. The connection to the database (redis) was lost and
    //    restablished.
    //
-   // In both cases we have to retrieve all posts from redis and their
-   // number of visualizations.
+   // In the second case we only have to apply the entries of the
+   // posts log since the last one we have seen, see on_xrange.
+   // Otherwise we have to retrieve the posts from redis and their
+   // number of visualizations, see resync_posts.
+   //
+   // In both cases we subscribe first, so that no event is missed
+   // between reading the log and subscribing.
 
    log::write( log::level::info
 	     , "on_hello: connection with Redis stablished.");
 
+   // Replies to requests sent before the connection was lost won't
+   // arrive.
+   log_read_pending_ = false;
+   log_read_again_ = false;
+   pending_hdels_.clear();
+
+   auto f = [&, this](aedis::request& req)
+      { req.subscribe(cfg_.redis.posts_channel_key); };
+
+   redis_conn_->send(f);
+
+   if (std::empty(last_log_id_)) {
+      resync_posts();
+   } else {
+      reload_visualizations_ = true;
+      read_posts_log();
+   }
+}
+
+void worker::resync_posts()
+{
+   // The id of the last log entry is read before the posts, so
+   // entries added in between are applied again on the next read of
+   // the log, which is harmless.
+   auto const reconcile = posts_.size() != 0;
+
+   // The log may be empty or not yet exist, in which case there
+   // would be no entry to continue from. A marker, that nodes
+   // ignore, guarantees there is one.
+   json marker;
+   marker["cmd"] = "sync";
+
    auto f = [&, this](aedis::request& req)
    {
-      req.hvals(cfg_.redis.posts_key);
-      req.subscribe(cfg_.redis.posts_channel_key);
+      log_post_event(req, marker.dump());
+      req.xrevrange(cfg_.redis.posts_log_key, "+", "-", "COUNT", 1);
+
+      // When we already have posts from a snapshot only the ids are
+      // retrieved and compared to ours, see on_hkeys.
+      if (reconcile)
+         req.hkeys(cfg_.redis.posts_key);
+      else
+         req.hvals(cfg_.redis.posts_key);
    };
 
    redis_conn_->send(f);
 }
 
+// Publications and deletions of posts are applied as they arrive on
+// the posts channel, where nodes of older versions publish them
+// without logging. The log is read after each of them to advance
+// last_log_id_, so that after a reconnection only the entries since
+// then are applied. Reads are coalesced so that there is at most one
+// in flight, it starts at the last entry applied so that we can tell
+// whether the log has been trimmed past it.
+void worker::read_posts_log()
+{
+   if (std::empty(last_log_id_) || log_read_pending_) {
+      log_read_again_ = true;
+      return;
+   }
+
+   log_read_pending_ = true;
+   log_read_again_ = false;
+
+   auto f = [&, this](aedis::request& req)
+      { req.xrange(cfg_.redis.posts_log_key, last_log_id_, "+"); };
+
+   redis_conn_->send(f);
+}
+
+// Entries arrive flattened as id, field, value, where the only field
+// is msg.
+void worker::on_xrevrange(aedis::resp::array_type& entries) noexcept
+{
+   // The log was deleted after the marker was added, we have to
+   // start over.
+   if (std::empty(entries)) {
+      log::write( log::level::notice
+		, "on_xrevrange: the posts log is empty. Resyncing.");
+      resync_posts();
+      return;
+   }
+
+   last_log_id_ = entries.front();
+
+   // Events that arrived during the resync.
+   if (log_read_again_)
+      read_posts_log();
+}
+
+void worker::on_xrange(aedis::resp::array_type& entries) noexcept
+{
+   log_read_pending_ = false;
+
+   // The range has to contain the last entry we have applied,
+   // otherwise the log was trimmed and we may have missed events.
+   auto const n = std::ssize(entries) / 3;
+
+   auto begin = n + 1;
+   if (std::ssize(entries) % 3 == 0) {
+      for (auto i = 0; i < n; ++i) {
+         if (entries[3 * i] == last_log_id_) {
+            begin = i + 1;
+            break;
+         }
+      }
+   }
+
+   if (begin > n) {
+      log::write( log::level::notice
+		, "on_xrange: entry {0} not in the posts log. Resyncing."
+		, last_log_id_);
+
+      last_log_id_.clear();
+      log_read_again_ = false;
+      reload_visualizations_ = false;
+      resync_posts();
+      return;
+   }
+
+   // Most entries have been applied from the posts channel already.
+   // A post published and removed in the range is skipped, as the
+   // removal may have been applied before.
+   std::vector<node_msg> msgs;
+   for (auto i = begin; i < n; ++i) {
+      try {
+	 msgs.push_back(parse_node_msg(entries[3 * i + 2]));
+      } catch (std::exception const& e) {
+	 log::write( log::level::err
+		   , "on_xrange: {0}"
+		   , e.what());
+      }
+   }
+
+   std::unordered_set<std::string_view> removed;
+   for (auto const& m : msgs) {
+      if (m.cmd == node_msg::kind::remove)
+	 removed.insert(m.post_id);
+   }
+
+   for (auto& m : msgs) {
+      switch (m.cmd) {
+	 case node_msg::kind::publish:
+	 {
+	    if (!removed.contains(m.item.id))
+	       apply_node_msg(m);
+	 } break;
+	 case node_msg::kind::remove:
+	 {
+	    if (!std::empty(posts_.get(m.post_id).id))
+	       apply_node_msg(m);
+	 } break;
+	 default:
+	    break;
+      }
+   }
+
+   last_log_id_ = entries[3 * (n - 1)];
+
+   log::write( log::level::debug
+	     , "on_xrange: {0} new entries in the posts log."
+	     , n - begin);
+
+   if (reload_visualizations_) {
+      reload_visualizations_ = false;
+
+      auto f = [&, this](aedis::request& req)
+	 { req.hgetall(cfg_.redis.post_visualizations_key); };
+
+      redis_conn_->send(f);
+   }
+
+   if (log_read_again_)
+      read_posts_log();
+}
+
+// Must be queued before the publish of the same event, in the same
+// request, so that nodes that read the log when the publish arrives
+// find the entry.
+void worker::log_post_event(aedis::request& req, std::string const& msg)
+{
+   auto const entry = std::make_pair(std::string {"msg"}, msg);
+   auto const list = {entry};
+   req.xadd(cfg_.redis.posts_log_key, cfg_.redis.posts_log_size, list);
+}
+
 void worker::on_hgetall(aedis::resp::array_type& v) noexcept
 {
    
@@ -180,7 +382,7 @@ void worker::on_push(aedis::resp::array_type& v) noexcept
    }
 
    if (v.front() == "message" && v[1] == cfg_.redis.posts_channel_key) {
-      on_db_channel_post(v.back());
+      on_posts_channel(v.back());
       return;
    }
 }
@@ -199,14 +401,24 @@ void worker::on_lrange(aedis::resp::array_type& msgs) noexcept
 
 void worker::on_hvals(aedis::resp::array_type& msgs) noexcept
 {
+   using namespace std::chrono;
+
    log::write( log::level::info
 	     , "on_hvals: {0} messages received."
 	     , std::size(msgs));
 
-   auto loader = [this](auto const& msg)
-      { on_db_channel_post(msg); };
+   // This is the initial load or a reload after a reconnection, in
+   // both cases the posts in redis replace the ones we have.
+   // Expired posts are removed later by the expiration timer.
+   auto const t0 = steady_clock::now();
+   int const n_threads = std::thread::hardware_concurrency();
+   posts_.load(parse_posts(msgs, n_threads));
+   auto const t1 = steady_clock::now();
 
-   std::for_each(std::begin(msgs), std::end(msgs), loader);
+   log::write( log::level::info
+	     , "on_hvals: {0} posts loaded in {1}ms."
+	     , posts_.size()
+	     , duration_cast<milliseconds>(t1 - t0).count());
 
    auto f = [&, this](aedis::request& req)
       { req.hgetall(cfg_.redis.post_visualizations_key); };
@@ -214,12 +426,128 @@ void worker::on_hvals(aedis::resp::array_type& msgs) noexcept
    redis_conn_->send(f);
 }
 
+void worker::on_hkeys(aedis::resp::array_type& ids) noexcept
+{
+   auto const missing = posts_.reconcile(ids);
+
+   log::write( log::level::info
+	     , "on_hkeys: {0} posts in redis, {1} missing."
+	     , std::size(ids)
+	     , std::size(missing));
+
+   auto f = [&, this](aedis::request& req)
+   {
+      if (std::empty(missing))
+	 req.hgetall(cfg_.redis.post_visualizations_key);
+      else
+	 req.hmget(cfg_.redis.posts_key, std::cbegin(missing), std::cend(missing));
+   };
+
+   redis_conn_->send(f);
+}
+
+void worker::on_hmget(aedis::resp::array_type& msgs) noexcept
+{
+   int const n_threads = std::thread::hardware_concurrency();
+   auto posts = parse_posts(msgs, n_threads);
+
+   // Posts published in the meantime may have been applied from the
+   // posts log already.
+   for (auto& p : posts) {
+      if (std::empty(posts_.get(p.id).id))
+	 posts_.add_post(std::move(p));
+   }
+
+   log::write( log::level::info
+	     , "on_hmget: {0} posts received."
+	     , std::size(posts));
+
+   auto f = [&, this](aedis::request& req)
+      { req.hgetall(cfg_.redis.post_visualizations_key); };
+
+   redis_conn_->send(f);
+}
+
+void worker::load_snapshot()
+{
+   using namespace std::chrono;
+
+   try {
+      auto const t0 = steady_clock::now();
+      auto s = read_snapshot(cfg_.snapshot_file);
+      posts_.load(std::move(s.posts));
+      auto const t1 = steady_clock::now();
+
+      // The older the snapshot the more posts will be fetched from
+      // redis, see on_hkeys.
+      auto const now =
+	 duration_cast<seconds>(system_clock::now().time_since_epoch());
+
+      log::write( log::level::notice
+		, "Snapshot with {0} posts from {1}s ago loaded in {2}ms."
+		, posts_.size()
+		, (now - s.time).count()
+		, duration_cast<milliseconds>(t1 - t0).count());
+   } catch (std::exception const& e) {
+      log::write( log::level::notice
+		, "worker::load_snapshot: {0}"
+		, e.what());
+   }
+}
+
+void worker::save_snapshot()
+{
+   using namespace std::chrono;
+
+   try {
+      auto const now =
+	 duration_cast<seconds>(system_clock::now().time_since_epoch());
+      write_snapshot(cfg_.snapshot_file, posts_, now);
+   } catch (std::exception const& e) {
+      log::write( log::level::err
+		, "worker::save_snapshot: {0}"
+		, e.what());
+   }
+}
+
+void worker::start_snapshot_timer()
+{
+   auto f = [this](auto const& ec)
+   {
+      if (ec)
+	 return;
+
+      save_snapshot();
+      start_snapshot_timer();
+   };
+
+   snapshot_timer_.expires_after(std::chrono::seconds {cfg_.snapshot_interval});
+   snapshot_timer_.async_wait(f);
+}
+
+// All nodes remove the expired posts but only those whose HDEL
+// removed them from the posts key move them to the removed posts key,
+// normally a single one.
 void worker::on_hdel(aedis::resp::number_type n) noexcept
 {
    log::write(
       log::level::info,
       "on_hdel: number of removed posts {0}.",
       n);
+
+   if (std::empty(pending_hdels_))
+      return;
+
+   auto const removed = std::move(pending_hdels_.front());
+   pending_hdels_.pop_front();
+
+   if (n == 0 || std::empty(removed))
+      return;
+
+   auto f = [&, this](aedis::request& req)
+      { req.hset(cfg_.redis.removed_posts_key, removed); };
+
+   redis_conn_->send(f);
 }
 
 void worker::on_session_dtor(
@@ -254,19 +582,37 @@ void worker::on_session_dtor(
 ev_res worker::on_app(std::shared_ptr<ws_session_base> s , std::string msg) noexcept
 {
    try {
-      auto j = json::parse(msg);
-      auto const cmd = j.at("cmd").get<std::string>();
-
-      if (s->is_logged_in()) {
-	 if (cmd == "presence")
-	    return on_app_presence(std::move(j), s);
-	 if (cmd == "message")
-	    return on_app_chat_msg(std::move(j), s);
-	 if (cmd == "publish")
-	    return on_app_publish(std::move(j), s);
-      } else {
-	 if (cmd == "login")
-	    return on_app_login(j, s);
+      // Only the fields the commands need are read, no json document
+      // is built.
+      if (!app_msg_.parse(msg)) {
+	 log::write(log::level::debug, "worker::on_app: Invalid message.");
+	 return ev_res::unknown;
+      }
+
+      auto const logged_in = s->is_logged_in();
+      switch (app_msg_.cmd()) {
+	 case app_cmd::login:
+	 {
+	    if (!logged_in)
+	       return on_app_login(app_msg_, s);
+	 } break;
+	 case app_cmd::message:
+	 {
+	    if (logged_in)
+	       return on_app_chat_msg(app_msg_, s);
+	 } break;
+	 case app_cmd::presence:
+	 {
+	    if (logged_in)
+	       return on_app_presence(app_msg_, s);
+	 } break;
+	 case app_cmd::publish:
+	 {
+	    if (logged_in)
+	       return on_app_publish(app_msg_, s);
+	 } break;
+	 default:
+	    break;
       }
    } catch (std::exception const& e) {
       log::write(log::level::debug, "worker::on_app: {0}.", e.what());
@@ -275,14 +621,47 @@ ev_res worker::on_app(std::shared_ptr<ws_session_base> s , std::string msg) noex
    return ev_res::unknown;
 }
 
-std::vector<post> worker::search_posts(post const& p) const
+void
+worker::search_posts(
+   post const& p,
+   std::string const& cursor,
+   channel::order_by by,
+   std::string& out)
 {
-   return posts_.query(p, cfg_.max_posts_on_search);
+   // Cached pages keep the visualizations they were computed with
+   // until posts are added to or removed from the query subtree.
+   auto key = fmt::format("s{0}:{1}:{2}", static_cast<int>(by), cursor, canonical_query(p));
+   if (auto const* body = search_cache_.find(key, posts_.generation(p))) {
+      out += *body;
+      return;
+   }
+
+   // The posts come serialized from the channel.
+   auto next = cursor;
+   std::string posts;
+   posts_.query_json(p, cfg_.max_posts_on_search, next, by, posts);
+
+   auto const begin = std::size(out);
+   write_search_response(out, next, posts);
+   search_cache_.insert(std::move(key), posts_.generation(), out.substr(begin));
 }
 
-int worker::count_posts(post const& p) const
+void worker::count_posts(post const& p, std::string& out)
 {
-   return posts_.count(p);
+   auto key = "c" + canonical_query(p);
+   if (auto const* body = search_cache_.find(key, posts_.generation(p))) {
+      out += *body;
+      return;
+   }
+
+   auto body = std::to_string(posts_.count(p));
+   out += body;
+   search_cache_.insert(std::move(key), posts_.generation(), std::move(body));
+}
+
+code_counter::facets worker::facet_posts(post const& p) const
+{
+   return posts_.facets(p);
 }
 
 worker_stats worker::get_stats() const noexcept
@@ -292,6 +671,9 @@ worker_stats worker::get_stats() const noexcept
    wstats.number_of_sessions = ws_stats_.number_of_sessions;
    wstats.db_post_queue_size = 0;
    wstats.db_chat_queue_size = std::size(user_ids_chat_queue);
+   wstats.search_cache_hits = search_cache_.hits();
+   wstats.search_cache_misses = search_cache_.misses();
+   wstats.search_cache_size = search_cache_.size();
 
    return wstats;
 }
@@ -306,12 +688,12 @@ void worker::delete_post(
    // are already sold. To delete from the workers it is enough to
    // broadcast a delete command.
 
-   json j;
-   j["cmd"] = "delete";
-   j["from"] = make_hex_digest(user, key);
-   j["post_id"] = post_id;
+   node_msg m;
+   m.cmd = node_msg::kind::remove;
+   m.from = make_hex_digest(user, key);
+   m.post_id = post_id;
 
-   auto const msg = j.dump();
+   auto const msg = serialize(m, cfg_.redis.posts_channel_binary);
 
    // We have to remove the post from one redis key and add to
    // another.
@@ -333,6 +715,8 @@ void worker::delete_post(
       auto const list = {pair};
       req.hset(cfg_.redis.removed_posts_key, list);
       req.hdel(cfg_.redis.posts_key, {post_id});
+      pending_hdels_.push_back({});
+      log_post_event(req, msg);
       req.publish(cfg_.redis.posts_channel_key, msg);
    };
 
@@ -375,49 +759,46 @@ std::vector<std::string> worker::get_upload_credit()
 void worker::on_visualization(std::string const& msg)
 {
    auto const j = json::parse(msg);
-   auto const post_id = j.at("post_id").get<std::string>();
+
+   node_msg m;
+   m.cmd = node_msg::kind::visualization;
+   m.post_id = j.at("post_id").get<std::string>();
+
+   auto const channel_msg =
+      cfg_.redis.posts_channel_binary ? serialize(m, true) : msg;
 
    auto f = [&](aedis::request& req)
    {
-      req.publish(cfg_.redis.posts_channel_key, msg);
-      req.hincrby(cfg_.redis.post_visualizations_key, post_id, 1);
+      req.publish(cfg_.redis.posts_channel_key, channel_msg);
+      req.hincrby(cfg_.redis.post_visualizations_key, m.post_id, 1);
    };
 
    redis_conn_->send(f);
 }
 
-std::string worker::on_get_user_id()
+void worker::on_get_user_id(std::string& out)
 {
    auto const user = pwdgen_.make(cfg_.pwd_size);
    auto const key = pwdgen_.make_key();
    auto const user_id = make_hex_digest(user, key);
 
-   json resp;
-   resp["result"] = "ok";
-   resp["user"] = user;
-   resp["key"] = key;
-   resp["user_id"] = user_id;
-
-   return resp.dump();
+   write_user_id(out, user, key, user_id);
 }
 
-std::string worker::on_publish_impl(json j)
+void worker::on_publish_impl(app_msg& m, std::string& out)
 {
    using namespace std::chrono;
 
-   auto const user = j.at("user").get<std::string>();
-   auto const key = j.at("key").get<std::string>();
+   std::string const user {m.get_string("user")};
+   std::string const key {m.get_string("key")};
    auto const user_id = make_hex_digest(user, key);
 
    if (std::empty(user_id)) {
-      json ack;
-      ack["cmd"] = "publish_ack";
-      ack["result"] = "fail";
-      ack["reason"] = "Invalid user id.";
-      return ack.dump();
+      write_publish_fail(out, "Invalid user id.");
+      return;
    }
 
-   auto p = j.at("post").get<post>();
+   auto p = json::parse(m.raw("post")).get<post>();
 
    // TODO: Implement a publication limit by consulting the number
    // of posts the user already has on the channel object.
@@ -433,18 +814,24 @@ std::string worker::on_publish_impl(json j)
       "on_publish_impl: new post from user {0}",
       p.from);
 
-   json pub;
-   pub["cmd"] = "publish_internal";
-   pub["post"] = p;
+   node_msg pub;
+   pub.cmd = node_msg::kind::publish;
+   pub.item = std::move(p);
 
-   auto const msg = pub.dump();
+   // The posts key stays in json, it is read on startup by nodes of
+   // any version.
+   auto const msg = serialize(pub, false);
+   auto const channel_msg =
+      cfg_.redis.posts_channel_binary ? serialize(pub, true) : msg;
 
+   auto const& id = pub.item.id;
    auto f = [&, this](aedis::request& req)
    {
-      auto const pair = std::make_pair(p.id, msg);
+      auto const pair = std::make_pair(id, msg);
       auto const list = {pair};
       req.hset(cfg_.redis.posts_key, list);
-      req.publish(cfg_.redis.posts_channel_key, msg);
+      log_post_event(req, channel_msg);
+      req.publish(cfg_.redis.posts_channel_key, channel_msg);
    };
 
    redis_conn_->send(f);
@@ -452,27 +839,20 @@ std::string worker::on_publish_impl(json j)
    // It is important that the publisher receives this message before any
    // user sends him a user message about the post. He needs a post_id to
    // know to which post the user refers to.
-   json ack;
-   ack["cmd"] = "publish_ack";
-   ack["result"] = "ok";
-   ack["id"] = p.id;
-   ack["date"] = p.date.count();
-
+   //
    // We do not send the read admin id to the app but an identifier so
    // that if we can change the id in the server and always use the
    // same identifier. Otherwise we would have to update the id in the
    // app which is bad. At the moment we are going to always use the
    // same identifier.
-   ack["admin_id"] = chat_admin_id_key;
-
-   return ack.dump();
+   write_publish_ack(out, id, pub.item.date.count(), chat_admin_id_key);
 }
 
 ev_res
-worker::on_app_login(json const& j, std::shared_ptr<ws_session_base> s)
+worker::on_app_login(app_msg& m, std::shared_ptr<ws_session_base> s)
 {
-   auto const user = j.at("user").get<std::string>();
-   auto const key = j.at("key").get<std::string>();
+   std::string const user {m.get_string("user")};
+   std::string const key {m.get_string("key")};
    auto const user_id = make_hex_digest(user, key);
 
    log::write( log::level::debug
@@ -480,16 +860,16 @@ worker::on_app_login(json const& j, std::shared_ptr<ws_session_base> s)
 	     , user, user_id);
 
    if (std::empty(user_id)) {
-      json resp;
-      resp["cmd"] = "login_ack";
-      resp["result"] = "fail";
-      s->send(resp.dump(), false);
+      std::string resp;
+      write_login_ack(resp, false);
+      s->send(std::move(resp), false);
       return ev_res::login_fail;
    }
 
-   s->set_pub_hash(user_id);
+   auto const pub_hash = posts_.intern(user_id);
+   s->set_pub_hash(pub_hash);
 
-   auto const ss = sessions_.insert({user_id, s});
+   auto const ss = sessions_.insert({pub_hash, s});
    if (!ss.second) {
       // There should never be more than one session with
       // the same id. For now, I will simply override the
@@ -503,7 +883,7 @@ worker::on_app_login(json const& j, std::shared_ptr<ws_session_base> s)
 	 // We have to prevent the cleanup operation when its
 	 // destructor is called. That would cause the new
 	 // session to be removed from the map again.
-	 old_ss->set_pub_hash("");
+	 old_ss->set_pub_hash({});
       } else {
 	 // Awckward, the old session has already expired and
 	 // we did not remove it from the map. It should be
@@ -513,9 +893,10 @@ worker::on_app_login(json const& j, std::shared_ptr<ws_session_base> s)
       ss.first->second = s;
    }
 
-   auto const match = j.find("token");
-   if (match != std::cend(j)) {
-      if (!std::empty(*match)) {
+   // The token is optional and may be null.
+   if (m.contains("token") && m.raw("token").front() == '"') {
+      std::string const token {m.get_string("token")};
+      if (!std::empty(token)) {
 	 // The app sent us a fcm token. We have to
 	 //
 	 // 1. Publish it in the channel where occase-notify is
@@ -524,7 +905,6 @@ worker::on_app_login(json const& j, std::shared_ptr<ws_session_base> s)
 	 // 2. Add to the redis hash-key where occase-notify can
 	 //    load when it is restarted.
 
-	 std::string const token = *match;
 	 json jtoken;
 	 jtoken["cmd"] = "token";
 	 jtoken["user_id"] = user_id;
@@ -565,80 +945,70 @@ worker::on_app_login(json const& j, std::shared_ptr<ws_session_base> s)
 
    redis_conn_->send(f);
 
-   json resp;
-   resp["cmd"] = "login_ack";
-   resp["result"] = "ok";
-
-   s->send(resp.dump(), false);
+   std::string resp;
+   write_login_ack(resp, true);
+   s->send(std::move(resp), false);
 
    return ev_res::login_ok;
 }
 
-std::string worker::get_chat_to_field(json& j, std::string& new_to)
+std::string_view worker::chat_destination(std::string_view to) const
 {
-   auto const to = j.at("to").get<std::string>();
-   new_to = to;
-   if (to == chat_admin_id_key) {
-      new_to = cfg_.chat_admin_id;
-      j["to"] = new_to;
-   }
+   if (to == chat_admin_id_key)
+      return cfg_.chat_admin_id;
 
    return to;
 }
 
-ev_res worker::on_app_chat_msg(json j, std::shared_ptr<ws_session_base> s)
+ev_res worker::on_app_chat_msg(app_msg& m, std::shared_ptr<ws_session_base> s)
 {
-   j["from"] = s->get_pub_hash();
+   // The message is forwarded as the app sent it, only the from and
+   // to fields are replaced. The rest is opaque to the server.
+   auto const old_to = m.get_string("to");
+   auto const to = chat_destination(old_to);
+
+   std::string msg;
+   m.rewrite({{"from", s->get_pub_hash()}, {"to", to}}, msg);
 
    // If the user is online in this node we can send him a message
    // directly.  This is important to reduce the amount of data in
    // redis, occase-notify and to reduce the communication latency.
-   std::string to;
-   auto const old_to = get_chat_to_field(j, to);
-
    auto const match = sessions_.find(to);
    if (match == std::end(sessions_)) {
       // The peer is either offline or not in this node. We have to
       // store the message in the database (redis).
-      auto const msg = j.dump();
       std::initializer_list<std::string_view> list = {msg};
       store_chat_msg(std::cbegin(list), std::cend(list), to);
    } else {
       // The peer is online and in this node, we can send him the
       // message directly.
       if (auto ss = match->second.lock())
-	 ss->send(j.dump(), true);
+	 ss->send(std::move(msg), true);
    }
 
    // No need to store the ack in the database as the user will resend
    // the message if the connection breaks and has to be restablished. 
-   auto const post_id = j.at("post_id").get<std::string>();
-   auto const message_id = j.at("id").get<int>();
-   json ack;
-   ack["cmd"] = "message";
-   ack["from"] = old_to;
-   ack["to"] = s->get_pub_hash();
-   ack["post_id"] = post_id;
-   ack["ack_id"] = message_id;
-   ack["type"] = "server_ack";
-   ack["result"] = "ok";
-
-   s->send(ack.dump(), false);
+   auto const post_id = m.get_string("post_id");
+   auto const message_id = m.get_int("id");
+
+   std::string ack;
+   write_server_ack(ack, old_to, s->get_pub_hash(), post_id, message_id);
+   s->send(std::move(ack), false);
    return ev_res::chat_msg_ok;
 }
 
-ev_res worker::on_app_presence(json j, std::shared_ptr<ws_session_base> s)
+ev_res worker::on_app_presence(app_msg& m, std::shared_ptr<ws_session_base> s)
 {
    // See also comments in on_app_chat_msg.
+   auto const to = chat_destination(m.get_string("to"));
 
-   j["from"] = s->get_pub_hash();
+   std::string msg;
+   m.rewrite({{"from", s->get_pub_hash()}, {"to", to}}, msg);
 
-   std::string to;
-   get_chat_to_field(j, to);
    auto const match = sessions_.find(to);
    if (match == std::end(sessions_)) {
-      auto const msg = j.dump();
-      auto const channel = cfg_.redis.presence_channel_prefix + to;
+      auto channel = cfg_.redis.presence_channel_prefix;
+      channel += to;
 
       auto f = [&](aedis::request& req)
 	 { req.publish(channel, msg); };
@@ -646,15 +1016,17 @@ ev_res worker::on_app_presence(json j, std::shared_ptr<ws_session_base> s)
       redis_conn_->send(f);
    } else {
       if (auto ss = match->second.lock())
-	 ss->send(j.dump(), false);
+	 ss->send(std::move(msg), false);
    }
 
    return ev_res::presence_ok;
 }
 
-ev_res worker::on_app_publish(json j, std::shared_ptr<ws_session_base> s)
+ev_res worker::on_app_publish(app_msg& m, std::shared_ptr<ws_session_base> s)
 {
-   s->send(on_publish_impl(j), true);
+   std::string ack;
+   on_publish_impl(m, ack);
+   s->send(std::move(ack), true);
    return ev_res::publish_ok;
 }
 
@@ -687,77 +1059,67 @@ void worker::on_db_chat_msg(
    assert(false);
 }
 
-void worker::on_db_channel_post(std::string const& msg)
+// Messages are applied right away. Publications and deletions are
+// also in the posts log, unless they come from nodes of older
+// versions, see read_posts_log.
+void worker::on_posts_channel(std::string const& msg)
 {
-   using namespace std::chrono;
-
    try {
-      auto const j = json::parse(msg);
-      auto const cmd = j.at("cmd").get<std::string>();
-
-      if (cmd == "visualization") {
-	 auto const post_id = j.at("post_id").get<std::string>();
-	 posts_.on_visualization(post_id);
+      // Json messages come from nodes that don't use the binary
+      // envelope.
+      auto m = parse_node_msg(msg);
+      apply_node_msg(m);
+      if (m.cmd == node_msg::kind::visualization)
 	 return;
-      }
+   } catch (std::exception const& e) {
+      log::write( log::level::err
+		, "worker::on_posts_channel: {0}"
+		, e.what());
+
+      log::write( log::level::err
+		, "worker::on_posts_channel: {0}"
+		, msg);
+   }
+
+   read_posts_log();
+}
 
-      if (cmd == "delete") {
-	 auto const post_id = j.at("post_id").get<std::string>();
-	 auto const from = j.at("from").get<std::string>();
-	 auto const ignore_owner = from == cfg_.chat_admin_id;
-	 if (posts_.remove_post(post_id, from, ignore_owner)) {
+void worker::apply_node_msg(node_msg& m)
+{
+   switch (m.cmd) {
+      case node_msg::kind::visualization:
+      {
+	 posts_.on_visualization(m.post_id);
+      } break;
+      case node_msg::kind::remove:
+      {
+	 auto const ignore_owner = m.from == cfg_.chat_admin_id;
+	 if (posts_.remove_post(m.post_id, m.from, ignore_owner)) {
 	    log::write( log::level::notice
 		      , "Success: post {0} removed. User {1}"
-		      , post_id
-		      , from);
+		      , m.post_id
+		      , m.from);
 	 } else {
 	    log::write( log::level::notice
 		      , "Error: post {0} not removed. User {1}"
-		      , post_id
-		      , from);
-	 }
-
-	 return;
-      }
-
-      if (cmd == "publish_internal") {
-	 auto const item = j.at("post").get<post>();
-
-	 auto const now =
-	    duration_cast<seconds>(system_clock::now().time_since_epoch());
-	 auto const post_exp = cfg_.timeouts.post_expiration;
-	 posts_.add_post(item);
-	 auto const expired = posts_.remove_expired_posts(now, post_exp);
-
-	 // NOTE: When we issue the delete command to the other
-	 // databases, we are in fact also sending a delete cmd to
-	 // ourselves and in this case the deletions will fail
-	 // (they have already been removed). This is not bad since
-	 // it simplifies the code and there are also tipically not
-	 // so many posts in each deletion, it
-	 // presents no performance problems in any case.
-
-	 auto f = [this](auto const& p)
-	    { /*Perhaps won't implement this.*/ };
-
-	 std::for_each( std::cbegin(expired)
-		      , std::cend(expired)
-		      , f);
-
-	 if (!std::empty(expired)) {
-	    log::write( log::level::info
-		      , "Number of expired posts removed: {0}"
-		      , std::size(expired));
+		      , m.post_id
+		      , m.from);
 	 }
-      }
-   } catch (std::exception const& e) {
-      log::write( log::level::err
-		, "on_db_channel_post (1): {0}"
-		, e.what());
-
-      log::write( log::level::err
-		, "on_db_channel_post (2): {0}"
-		, msg);
+      } break;
+      case node_msg::kind::publish:
+      {
+	 // The same publication may arrive on the posts channel and
+	 // from the posts log.
+	 if (!std::empty(posts_.get(m.item.id).id))
+	    return;
+
+	 posts_.add_post(std::move(m.item));
+
+	 // The bulk of the work is done by the expiration timer.
+	 remove_expired_posts();
+      } break;
+      default:
+	 break;
    }
 }
 
@@ -807,6 +1169,86 @@ void worker::on_signal(boost::system::error_code const& ec, int n)
    shutdown_impl();
 }
 
+void worker::start_expiration_timer(std::chrono::seconds s)
+{
+   auto f = [this](auto const& ec)
+      { on_expiration_timer(ec); };
+
+   expiration_timer_.expires_after(s);
+   expiration_timer_.async_wait(f);
+}
+
+void worker::on_expiration_timer(boost::system::error_code const& ec)
+{
+   if (ec) {
+      if (ec == net::error::operation_aborted)
+	 return;
+
+      log::write( log::level::err
+		, "worker::on_expiration_timer: {0}"
+		, ec.message());
+   }
+
+   // When the batch is full there may be more expired posts. They are
+   // removed in the next round of the event loop so that other
+   // handlers are not starved.
+   auto const full = remove_expired_posts();
+   if (full) {
+      start_expiration_timer(std::chrono::seconds {0});
+      return;
+   }
+
+   if (posts_.compact()) {
+      log::write( log::level::info
+		, "Channel compacted to {0} posts."
+		, posts_.size());
+   }
+
+   start_expiration_timer(cfg_.timeouts.post_expiration_interval);
+}
+
+// Removes at most one batch of expired posts locally and from the posts
+// key in a single command, see on_hdel. Returns true when the batch
+// was full.
+bool worker::remove_expired_posts()
+{
+   using namespace std::chrono;
+
+   auto const now =
+      duration_cast<seconds>(system_clock::now().time_since_epoch());
+
+   auto const expired =
+      posts_.remove_expired_posts(
+	 now,
+	 cfg_.timeouts.post_expiration,
+	 cfg_.post_expiration_batch);
+
+   if (std::empty(expired))
+      return false;
+
+   std::vector<std::string> ids;
+   std::vector<std::pair<std::string, std::string>> removed;
+   for (auto const& p : expired) {
+      json j = p;
+      ids.push_back(p.id);
+      removed.push_back({p.id, j.dump()});
+   }
+
+   auto f = [&, this](aedis::request& req)
+   {
+      req.hdel(cfg_.redis.posts_key, std::cbegin(ids), std::cend(ids));
+      pending_hdels_.push_back(std::move(removed));
+   };
+
+   redis_conn_->send(f);
+
+   log::write( log::level::info
+	     , "Number of expired posts removed: {0}"
+	     , std::size(expired));
+
+   return std::ssize(expired) == cfg_.post_expiration_batch;
+}
+
 void worker::shutdown()
 {
    shutdown_impl();
@@ -830,6 +1272,13 @@ void worker::shutdown_impl()
 
    acceptor_.shutdown();
 
+   expiration_timer_.cancel();
+
+   if (!std::empty(cfg_.snapshot_file)) {
+      snapshot_timer_.cancel();
+      save_snapshot();
+   }
+
    auto f = [](auto o)
    {
       if (auto s = o.second.lock())
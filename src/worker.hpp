@@ -1,6 +1,7 @@
 #pragma once
 
 #include <array>
+#include <deque>
 #include <vector>
 #include <memory>
 #include <string>
@@ -16,7 +17,11 @@
 #include "config.hpp"
 #include "logger.hpp"
 #include "crypto.hpp"
+#include "node_msg.hpp"
+#include "app_msg.hpp"
 #include "channel.hpp"
+#include "snapshot.hpp"
+#include "query_cache.hpp"
 #include "acceptor_mgr.hpp"
 #include "ws_session_base.hpp"
 
@@ -33,6 +38,9 @@ struct worker_stats {
    int worker_login_queue_size = 0;
    int db_post_queue_size = 0;
    int db_chat_queue_size = 0;
+   std::uint64_t search_cache_hits = 0;
+   std::uint64_t search_cache_misses = 0;
+   std::size_t search_cache_size = 0;
 };
 
 std::ostream& operator<<(std::ostream& os, worker_stats const& stats);
@@ -45,12 +53,24 @@ private:
    config::core const cfg_;
    ws_stats ws_stats_;
 
-   // Maps a user id in to a websocket session.
-   std::unordered_map< std::string
+   channel posts_;
+
+   // The responses to /posts/search and /posts/count, see
+   // count_posts and search_posts.
+   query_cache search_cache_;
+
+   // Holds the fields of the app message being handled. It is reused
+   // for all messages so that its buffers are allocated only once.
+   app_msg app_msg_;
+
+   // Maps a user id in to a websocket session. The ids are interned
+   // in the channel so that they are shared with the posts of the
+   // user.
+   std::unordered_map< interned_string
                      , std::weak_ptr<ws_session_base>
+                     , interned_hash
+                     , std::equal_to<>
                      > sessions_;
-
-   channel posts_;
    std::shared_ptr<aedis::connection> redis_conn_;
 
    // When a user logs in or we receive a notification from the
@@ -70,13 +90,37 @@ private:
    // Signal handler.
    net::signal_set signal_set_;
 
+   // Timer used to remove expired posts periodically.
+   net::steady_timer expiration_timer_;
+
+   // Timer used to write snapshots periodically.
+   net::steady_timer snapshot_timer_;
+
+   // The id of the last entry of the posts log that has been applied
+   // to the channel. Empty when unknown.
+   std::string last_log_id_;
+
+   // Whether a read of the posts log is in flight and whether
+   // another one is needed when it completes, see read_posts_log.
+   bool log_read_pending_ = false;
+   bool log_read_again_ = false;
+
+   // Whether the visualizations have to be reloaded when the pending
+   // read of the posts log completes, i.e. after a reconnection.
+   bool reload_visualizations_ = false;
+
+   // The (id, json) pairs of the expired posts of each HDEL in
+   // flight, in the order they were sent. Empty for deletions by the
+   // user, see on_hdel.
+   std::deque<std::vector<std::pair<std::string, std::string>>> pending_hdels_;
+
 private:
    template <class Iter>
    void
    store_chat_msg(
       Iter begin,
       Iter end,
-      std::string const& to)
+      std::string_view to)
    {
       if (begin == end)
          return;
@@ -85,7 +129,8 @@ private:
                 , "store_chat_msg: sending message to {0}"
                 , to);
 
-      auto const key = cfg_.redis.chat_msg_prefix + to;
+      auto key = cfg_.redis.chat_msg_prefix;
+      key += to;
       auto f = [&, this](aedis::request& req)
       {
          req.incr(cfg_.redis.chat_msgs_counter_key);
@@ -100,19 +145,32 @@ private:
    }
 
    void init();
-   ev_res on_app_login(json const& j, std::shared_ptr<ws_session_base> s);
-   ev_res on_app_chat_msg(json j, std::shared_ptr<ws_session_base> s);
-   ev_res on_app_presence(json j, std::shared_ptr<ws_session_base> s);
-   ev_res on_app_publish(json j, std::shared_ptr<ws_session_base> s);
+   ev_res on_app_login(app_msg& m, std::shared_ptr<ws_session_base> s);
+   ev_res on_app_chat_msg(app_msg& m, std::shared_ptr<ws_session_base> s);
+   ev_res on_app_presence(app_msg& m, std::shared_ptr<ws_session_base> s);
+   ev_res on_app_publish(app_msg& m, std::shared_ptr<ws_session_base> s);
    void on_db_chat_msg( std::string const& user_id, std::vector<std::string> const& msgs);
-   void on_db_channel_post(std::string const& msg);
+   void apply_node_msg(node_msg& m);
+   void on_posts_channel(std::string const& msg);
    void on_db_presence(std::string const& user_id, std::string msg);
    void on_signal(boost::system::error_code const& ec, int n);
+   void start_expiration_timer(std::chrono::seconds s);
+   void on_expiration_timer(boost::system::error_code const& ec);
+   bool remove_expired_posts();
+   void resync_posts();
+   void log_post_event(aedis::request& req, std::string const& msg);
+   void read_posts_log();
+   void load_snapshot();
+   void save_snapshot();
+   void start_snapshot_timer();
 
    // WARNING: Don't call this function from the signal handler.
    void shutdown();
    void shutdown_impl();
-   std::string get_chat_to_field(json& j, std::string& to);
+
+   // Returns the user that chat and presence messages sent to the
+   // given user are delivered to.
+   std::string_view chat_destination(std::string_view to) const;
 
 public:
    worker(config::core cfg, ssl::context& c);
@@ -125,6 +183,10 @@ public:
    void on_hvals(aedis::resp::array_type& msgs) noexcept override;
    void on_hgetall(aedis::resp::array_type& all) noexcept override;
    void on_hdel(aedis::resp::number_type n) noexcept override;
+   void on_hkeys(aedis::resp::array_type& ids) noexcept override;
+   void on_hmget(aedis::resp::array_type& msgs) noexcept override;
+   void on_xrange(aedis::resp::array_type& entries) noexcept override;
+   void on_xrevrange(aedis::resp::array_type& entries) noexcept override;
 
    void on_session_dtor( std::string const& user_id, std::vector<std::string> const& msgs);
    ev_res on_app(std::shared_ptr<ws_session_base> s , std::string msg) noexcept;
@@ -132,16 +194,28 @@ public:
    auto& get_ws_stats() noexcept { return ws_stats_;}
    auto const& get_ws_stats() const noexcept { return ws_stats_; }
    worker_stats get_stats() const noexcept;
-   int count_posts(post const& p) const;
-   std::vector<post> search_posts(post const& p) const;
+   code_counter::facets facet_posts(post const& p) const;
+
+   // Append the bodies of the /posts/count and /posts/search
+   // responses to out. They are served from the search cache while
+   // the posts that match did not change.
+   void count_posts(post const& p, std::string& out);
+   void
+   search_posts(
+      post const& p,
+      std::string const& cursor,
+      channel::order_by by,
+      std::string& out);
    auto& get_ioc() const noexcept { return ioc_; }
    void run() { ioc_.run(); }
    auto const& get_cfg() const noexcept { return cfg_; }
    void delete_post( std::string const& user, std::string const& key, std::string const& post_id);
    std::vector<std::string> get_upload_credit();
    void on_visualization(std::string const& msg);
-   std::string on_publish_impl(json j);
-   std::string on_get_user_id();
+
+   // Append the response to out.
+   void on_publish_impl(app_msg& m, std::string& out);
+   void on_get_user_id(std::string& out);
 };
 
 } // occase
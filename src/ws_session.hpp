@@ -15,6 +15,7 @@
 #include "post.hpp"
 #include "logger.hpp"
 #include "worker.hpp"
+#include "app_codec.hpp"
 #include "ws_session_base.hpp"
 
 namespace occase {
@@ -35,12 +36,18 @@ private:
    int pong_counter_ = 0;
    std::deque<msg_entry> msg_queue_;
    bool closing_ = false;
-   std::string pub_hash_;
+   interned_string pub_hash_;
    code_type any_of_filter_ = 0;
 
    boost::container::static_vector<code_type, ranges_size_> ranges_;
    worker& w_;
 
+   // Whether the app negotiated the binary subprotocol, see
+   // app_codec.hpp. The messages in the queue are always json and are
+   // converted to write_buffer_ right before being written.
+   bool binary_ = false;
+   std::string write_buffer_;
+
    Derived& derived() { return static_cast<Derived&>(*this); }
 
    void do_read()
@@ -52,15 +59,40 @@ private:
       derived().ws().async_read(buffer_, handler);
    }
 
-   void do_write(std::string const& msg)
+   // Writes the message at the front of the queue.
+   void do_write()
    {
-      derived().ws().text(derived().ws().got_text());
-
       auto self = derived().shared_from_this();
       auto handler = [self](auto ec, auto n)
          { self->on_write(ec, n); };
 
-      derived().ws().async_write(net::buffer(msg), handler);
+      if (!binary_) {
+         derived().ws().text(derived().ws().got_text());
+         derived().ws().async_write(net::buffer(msg_queue_.front().msg), handler);
+         return;
+      }
+
+      // Messages that can't be encoded are dropped. Kept at the front
+      // they would block the queue and, when persisted, be returned
+      // to the database and fail again on every login.
+      for (;;) {
+         try {
+            write_buffer_ = to_binary(msg_queue_.front().msg);
+            break;
+         } catch (std::exception const& e) {
+            log::write(log::level::err,
+	               "ws_session_impl::do_write: {0}. User {1}",
+		       e.what(),
+		       pub_hash_.str());
+         }
+
+         msg_queue_.pop_front();
+         if (std::empty(msg_queue_))
+            return;
+      }
+
+      derived().ws().binary(true);
+      derived().ws().async_write(net::buffer(write_buffer_), handler);
    }
 
    void on_read(boost::system::error_code ec, std::size_t bytes_transferred)
@@ -72,12 +104,25 @@ private:
          log::write(log::level::debug,
 	            "ws_session_impl::on_read: {0}. User {1}",
 		    ec.message(),
-		    pub_hash_);
+		    pub_hash_.str());
          return;
       }
 
       auto msg = beast::buffers_to_string(buffer_.data());
       buffer_.consume(std::size(buffer_));
+
+      if (binary_ && !derived().ws().got_text()) {
+         try {
+            msg = from_binary(msg);
+         } catch (std::exception const& e) {
+            // The empty message is rejected by the worker.
+            msg.clear();
+            log::write(log::level::debug,
+	               "ws_session_impl::on_read: {0}. User {1}",
+		       e.what(),
+		       pub_hash_.str());
+         }
+      }
       auto self = derived().shared_from_this();
       auto const r = w_.on_app(self, std::move(msg));
       handle_ev(r);
@@ -147,7 +192,7 @@ private:
 
       // Do not move the front msg. If the write fail we will want to
       // save the message in the database or whatever.
-      do_write(msg_queue_.front().msg);
+      do_write();
    }
 
    void handle_ev(ev_res r)
@@ -195,7 +240,7 @@ private:
                           , std::back_inserter(msgs)
                           , transformer);
 
-            w_.on_session_dtor(pub_hash_, msgs);
+            w_.on_session_dtor(pub_hash_.str(), msgs);
          }
       } catch (...) {
       }
@@ -222,8 +267,17 @@ public:
       derived().ws().set_option(wstm);
       auto const name = w_.get_cfg().server_name;
 
-      auto f = [=](websocket::response_type& res)
-         { res.set(http::field::server, name); };
+      // Apps that support the binary subprotocol offer it on upgrade,
+      // the others keep using json text frames.
+      auto const protocols = req[http::field::sec_websocket_protocol];
+      binary_ = offers_binary({protocols.data(), std::size(protocols)});
+
+      auto f = [=, binary = binary_](websocket::response_type& res)
+      {
+         res.set(http::field::server, name);
+         if (binary)
+            res.set(http::field::sec_websocket_protocol, std::string {binary_subprotocol});
+      };
 
       derived().ws().set_option(websocket::stream_base::decorator(f));
 
@@ -258,7 +312,7 @@ public:
       msg_queue_.push_back({std::move(msg), persist});
 
       if (is_empty && !closing_)
-         do_write(msg_queue_.front().msg);
+         do_write();
    }
 
    void shutdown() override final
@@ -266,7 +320,7 @@ public:
       if (closing_)
          return;
 
-      log::write(log::level::debug, "ws_session_impl::shutdown: {0}.", pub_hash_);
+      log::write(log::level::debug, "ws_session_impl::shutdown: {0}.", pub_hash_.str());
 
       closing_ = true;
 
@@ -278,11 +332,11 @@ public:
       derived().ws().async_close(reason, handler);
    }
 
-   void set_pub_hash(std::string hash) override final
+   void set_pub_hash(interned_string hash) override final
       { pub_hash_ = std::move(hash); };
 
    std::string const& get_pub_hash() const noexcept override final
-      { return pub_hash_;}
+      { return pub_hash_.str();}
 
    bool is_logged_in() const noexcept override final
       { return !std::empty(pub_hash_);};
@@ -5,6 +5,8 @@
 #include <string>
 #include <memory>
 
+#include "intern.hpp"
+
 namespace occase {
 
 enum class ev_res
@@ -24,7 +26,7 @@ enum class ev_res
 };
 
 struct ws_session_base {
-   virtual void set_pub_hash(std::string hash) {};
+   virtual void set_pub_hash(interned_string hash) {};
    virtual std::string const& get_pub_hash() const noexcept = 0;
    virtual bool is_logged_in() const noexcept = 0;
    virtual void shutdown() = 0;